@@ -1,14 +1,42 @@
 QT += widgets
 QT += xml
+QT += sql
+QT += network
+QT += concurrent
 requires(qtConfig(filedialog))
+CONFIG += c++14
 
 HEADERS       = mainwindow.h \
+                journal.h \
+                saver.h \
+                archive.h \
+                exporter.h \
+                sqlsync.h \
+                importer.h \
+                segmenteditor.h \
+                singleinstance.h \
+                queryserver.h \
+                segmentchart.h \
+                segmentscan.h \
                 xmledit.h \
+                attemptlayout.h \
                 watchers.h \
                 TableWidgetNoScroll.h
 SOURCES       = main.cpp \
                 mainwindow.cpp \
-                xmledit.cpp
+                xmledit.cpp \
+                attemptlayout.cpp \
+                journal.cpp \
+                saver.cpp \
+                archive.cpp \
+                exporter.cpp \
+                sqlsync.cpp \
+                importer.cpp \
+                segmenteditor.cpp \
+                singleinstance.cpp \
+                queryserver.cpp \
+                segmentchart.cpp \
+                segmentscan.cpp
 #! [0]
 RESOURCES     = application.qrc
 #! [0]
@@ -0,0 +1,81 @@
+#include "archive.h"
+#include <QFileInfo>
+#include <QtEndian>
+
+bool isArchivePath(const QString &fileName) {
+	return QFileInfo(fileName).suffix().compare(ARCHIVE_SUFFIX, Qt::CaseInsensitive) == 0;
+}
+
+static QByteArray lengthPrefix(quint32 length) {
+	char prefix[4];
+	qToBigEndian(length, prefix);
+	return QByteArray(prefix, 4);
+}
+
+QByteArray archiveFrame(const char *data, int length) {
+	QByteArray compressed = qCompress(reinterpret_cast<const uchar *>(data), length);
+	return lengthPrefix(compressed.size()) + compressed;
+}
+
+QByteArray archiveTrailer() {
+	return lengthPrefix(0);
+}
+
+bool ArchiveReader::detect(QIODevice *source) {
+	if (source->peek(ARCHIVE_MAGIC_SIZE) != QByteArray(ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE))
+		return false;
+	source->read(ARCHIVE_MAGIC_SIZE);
+	return true;
+}
+
+// Stop reading for good, with the reason as the device's error string
+bool ArchiveReader::damaged(const QString &why) {
+	setErrorString(tr("Not a valid archive: %1").arg(why));
+	corrupt = true;
+	finished = true;
+	return false;
+}
+
+// Replace buffer with the next decompressed frame. Returns false at the end or on damage
+bool ArchiveReader::nextFrame() {
+	buffer.clear();
+	bufferPos = 0;
+	if (finished)
+		return false;
+
+	QByteArray prefix = source->read(4);
+	if (prefix.size() != 4)
+		return damaged(tr("it ends without a trailer"));
+	quint32 length = qFromBigEndian<quint32>(prefix.constData());
+	if (length == 0) { // Trailer
+		finished = true;
+		return false;
+	}
+	if (length > ARCHIVE_FRAME_MAX) // No writer makes these, so don't allocate for it
+		return damaged(tr("a frame of %1 bytes is larger than any chunk").arg(length));
+
+	QByteArray frame = source->read(length);
+	if (frame.size() != int(length))
+		return damaged(tr("it ends in the middle of a frame"));
+	if (length < 4 || qFromBigEndian<quint32>(frame.constData()) > ARCHIVE_CHUNK_SIZE) // qUncompress would allocate what this says
+		return damaged(tr("a frame is larger than any chunk once decompressed"));
+	buffer = qUncompress(frame);
+	if (buffer.isEmpty()) // Chunks are never empty, so this is qUncompress failing
+		return damaged(tr("a frame can't be decompressed"));
+	return true;
+}
+
+qint64 ArchiveReader::readData(char *data, qint64 maxSize) {
+	qint64 total = 0;
+	while (total < maxSize) {
+		if (bufferPos == buffer.size() && !nextFrame())
+			break;
+		qint64 length = qMin<qint64>(maxSize - total, buffer.size() - bufferPos);
+		memcpy(data + total, buffer.constData() + bufferPos, length);
+		bufferPos += length;
+		total += length;
+	}
+	if (total == 0 && corrupt)
+		return -1;
+	return total;
+}
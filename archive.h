@@ -0,0 +1,51 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+// Compressed .lssz archives are the plain .lss XML cut into chunks, each compressed with qCompress:
+//     "LSSZ" { quint32 frameLength, qCompress(chunk) }... quint32 0
+// Lengths are big endian. Chunking lets the reader hand XML to the parser as it decompresses.
+#define ARCHIVE_MAGIC "LSSZ"
+#define ARCHIVE_MAGIC_SIZE 4
+#define ARCHIVE_CHUNK_SIZE (1024*1024) // Uncompressed bytes per frame
+// Largest frame the writer can produce: qCompress's 4-byte size header, then zlib's worst case
+// for a chunk (compressBound), which is a little over the chunk itself
+#define ARCHIVE_FRAME_MAX (4 + ARCHIVE_CHUNK_SIZE + ARCHIVE_CHUNK_SIZE/1000 + 64)
+#define ARCHIVE_SUFFIX "lssz"
+
+bool isArchivePath(const QString &fileName); // Should saving to this name compress?
+QByteArray archiveFrame(const char *data, int length); // Compress one chunk, with its length prefix
+QByteArray archiveTrailer();
+
+// Sequential read-only device which decompresses an archive from source one frame at a time
+class ArchiveReader : public QIODevice {
+	Q_OBJECT
+protected:
+	QIODevice *source;
+	QByteArray buffer; // Current decompressed frame
+	int bufferPos;
+	bool finished;
+	bool corrupt;
+
+	bool nextFrame();
+	bool damaged(const QString &why);
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *, qint64) override { return -1; }
+
+public:
+	// Source must be positioned just after the magic
+	explicit ArchiveReader(QIODevice *_source, QObject *parent = nullptr)
+		: QIODevice(parent), source(_source), bufferPos(0), finished(false), corrupt(false) {}
+
+	// If source starts with the archive magic, consume it and return true
+	static bool detect(QIODevice *source);
+
+	bool isSequential() const override { return true; }
+	qint64 bytesAvailable() const override { return buffer.size() - bufferPos + QIODevice::bytesAvailable(); }
+	bool atEnd() const override { return finished && bytesAvailable() == 0; } // An empty buffer isn't the end
+	bool isCorrupt() const { return corrupt; } // If so, errorString() says how
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "attemptlayout.h"
+#include <QWidget>
+#include <QHash>
+
+AttemptLayout::~AttemptLayout() {
+	for (QLayoutItem *item : items)
+		delete item;
+}
+
+void AttemptLayout::addItem(QLayoutItem *item) {
+	items.append(item);
+	invalidate();
+}
+
+QLayoutItem *AttemptLayout::takeAt(int index) {
+	if (index < 0 || index >= items.size())
+		return NULL;
+	QLayoutItem *item = items.takeAt(index);
+	invalidate();
+	return item;
+}
+
+// Every item gets its size hint's height, so the hint is also the least room the layout can take
+void AttemptLayout::workOutSizes() const {
+	int width = 0, minimumWidth = 0, height = 0, shown = 0;
+	for (QLayoutItem *item : items) {
+		if (item->isEmpty())
+			continue;
+		QSize hint = item->sizeHint();
+		width = qMax(width, hint.width());
+		minimumWidth = qMax(minimumWidth, item->minimumSize().width());
+		height += hint.height();
+		shown++;
+	}
+	if (shown > 1)
+		height += (shown - 1) * qMax(spacing(), 0);
+	QMargins margins = contentsMargins();
+	cachedHint = QSize(width + margins.left() + margins.right(), height + margins.top() + margins.bottom());
+	cachedMinimum = QSize(minimumWidth + margins.left() + margins.right(), cachedHint.height());
+}
+
+QSize AttemptLayout::sizeHint() const {
+	if (!cachedHint.isValid())
+		workOutSizes();
+	return cachedHint;
+}
+
+QSize AttemptLayout::minimumSize() const {
+	if (!cachedMinimum.isValid())
+		workOutSizes();
+	return cachedMinimum;
+}
+
+void AttemptLayout::setGeometry(const QRect &rect) {
+	QLayout::setGeometry(rect);
+	QRect inside = rect.marginsRemoved(contentsMargins());
+	int y = inside.y(), gap = qMax(spacing(), 0);
+	for (QLayoutItem *item : items) {
+		if (item->isEmpty())
+			continue;
+		int height = item->sizeHint().height();
+		item->setGeometry(QRect(inside.x(), y, inside.width(), height));
+		y += height + gap;
+	}
+}
+
+void AttemptLayout::invalidate() {
+	cachedHint = cachedMinimum = QSize();
+	QLayout::invalidate();
+}
+
+void AttemptLayout::permute(const QVector<QWidget *> &widgets) {
+	QHash<QWidget *, QLayoutItem *> byWidget;
+	byWidget.reserve(items.size());
+	for (QLayoutItem *item : items)
+		if (item->widget())
+			byWidget.insert(item->widget(), item);
+
+	QVector<QLayoutItem *> permuted;
+	permuted.reserve(items.size());
+	for (QWidget *widget : widgets) {
+		QLayoutItem *item = byWidget.take(widget);
+		if (item)
+			permuted.append(item);
+	}
+	for (QLayoutItem *item : items)
+		if (!item->widget() || byWidget.contains(item->widget()))
+			permuted.append(item);
+	items = permuted;
+	invalidate();
+}
+
+QLayoutItem *AttemptLayout::replace(QWidget *from, QWidget *to) {
+	for (QLayoutItem *&item : items) {
+		if (item->widget() != from)
+			continue;
+		QLayoutItem *old = item;
+		addChildWidget(to);
+		item = new QWidgetItem(to);
+		item->setAlignment(old->alignment());
+		invalidate();
+		return old;
+	}
+	return NULL;
+}
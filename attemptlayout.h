@@ -0,0 +1,36 @@
+#ifndef ATTEMPTLAYOUT_H
+#define ATTEMPTLAYOUT_H
+
+#include <QLayout>
+#include <QVector>
+
+// Stacks the attempts' widgets top to bottom, each at its size hint's height. Unlike QVBoxLayout,
+// the items can be put in a new order all at once, so sorting lays the attempts out once instead
+// of taking every widget out of the layout and adding it back.
+class AttemptLayout : public QLayout {
+protected:
+	QVector<QLayoutItem *> items;
+	mutable QSize cachedHint, cachedMinimum; // Invalid until worked out after each invalidate
+	void workOutSizes() const;
+public:
+	AttemptLayout() {}
+	~AttemptLayout();
+
+	void addItem(QLayoutItem *item) override;
+	int count() const override { return items.size(); }
+	QLayoutItem *itemAt(int index) const override { return items.value(index); }
+	QLayoutItem *takeAt(int index) override;
+	QSize sizeHint() const override;
+	QSize minimumSize() const override;
+	Qt::Orientations expandingDirections() const override { return Qt::Horizontal | Qt::Vertical; } // Spare room goes below the last attempt
+	void setGeometry(const QRect &rect) override;
+	void invalidate() override;
+
+	// Lay out widgets in this order. Items for widgets not listed keep their order after them
+	void permute(const QVector<QWidget *> &widgets);
+	// Put to in from's place and return from's item for the caller to delete, or NULL if from
+	// isn't here. QLayout::replaceWidget can't be used, as it needs Qt's private layout classes
+	QLayoutItem *replace(QWidget *from, QWidget *to);
+};
+
+#endif
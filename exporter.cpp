@@ -0,0 +1,164 @@
+#include "exporter.h"
+#include "xmledit.h"
+#include <QFileInfo>
+
+#define EXPORT_BUFFER_SIZE (64*1024)
+
+// Accumulates output in a fixed buffer and formats numbers in place, so no cell becomes a QString
+class BufferedWriter {
+protected:
+	QIODevice *out;
+	char buffer[EXPORT_BUFFER_SIZE];
+	int used;
+	bool failed;
+
+public:
+	BufferedWriter(QIODevice *_out) : out(_out), used(0), failed(false) {}
+
+	void flush() {
+		if (used && !failed && out->write(buffer, used) != used)
+			failed = true;
+		used = 0;
+	}
+	void put(char c) {
+		if (used == EXPORT_BUFFER_SIZE)
+			flush();
+		buffer[used++] = c;
+	}
+	void write(const char *data, int length) {
+		if (used + length > EXPORT_BUFFER_SIZE)
+			flush();
+		if (length > EXPORT_BUFFER_SIZE) { // Doesn't fit at all, skip the buffer
+			if (!failed && out->write(data, length) != length)
+				failed = true;
+			return;
+		}
+		memcpy(buffer + used, data, length);
+		used += length;
+	}
+	void write(const QByteArray &data) { write(data.constData(), data.size()); }
+	template<int N> void literal(const char (&s)[N]) { write(s, N-1); }
+	void number(quint64 value) {
+		char digits[20];
+		int count = 0;
+		do {
+			digits[count++] = '0' + value % 10;
+			value /= 10;
+		} while (value);
+		if (used + count > EXPORT_BUFFER_SIZE)
+			flush();
+		while (count)
+			buffer[used++] = digits[--count];
+	}
+	void signedNumber(qint64 value) {
+		if (value < 0) {
+			put('-');
+			number(quint64(0) - quint64(value));
+		} else {
+			number(quint64(value));
+		}
+	}
+	bool ok() const { return !failed; }
+};
+
+ExportFormat exportFormatForPath(const QString &fileName) {
+	QString suffix = QFileInfo(fileName).suffix().toLower();
+	if (suffix == "jsonl" || suffix == "ndjson")
+		return EXPORT_JSON_LINES;
+	return EXPORT_CSV;
+}
+
+// Strings are encoded once per attempt or segment, never per row
+static QByteArray csvString(const QString &s) {
+	QByteArray utf8 = s.toUtf8();
+	if (!utf8.contains(',') && !utf8.contains('"') && !utf8.contains('\n') && !utf8.contains('\r'))
+		return utf8;
+	return '"' + utf8.replace('"', "\"\"") + '"';
+}
+
+static QByteArray jsonString(const QString &s) {
+	QByteArray result("\"");
+	QByteArray utf8 = s.toUtf8();
+	for (char c : utf8) {
+		switch (c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (uchar(c) < 0x20) {
+					char escape[8];
+					qsnprintf(escape, sizeof(escape), "\\u%04x", uchar(c));
+					result += escape;
+				} else {
+					result += c;
+				}
+		}
+	}
+	return result + '"';
+}
+
+qint64 exportRuns(const XmlEdit &edit, QIODevice *out, ExportFormat format) {
+	const QStringList &splitNames = edit.segmentNames();
+	const QHash<qint64, SingleRun> &runs = edit.attemptRuns();
+	bool json = format == EXPORT_JSON_LINES;
+
+	QVector<QByteArray> encodedNames;
+	encodedNames.reserve(splitNames.size());
+	for (const QString &name : splitNames)
+		encodedNames.append(json ? jsonString(name) : csvString(name));
+	const QByteArray emptyName = json ? QByteArray("\"\"") : QByteArray();
+
+	BufferedWriter writer(out);
+	if (!json)
+		writer.literal("attempt_id,started,segment_index,segment_name,split_us,total_us,skipped\n");
+
+	qint64 rows = 0;
+	for (qint64 id : edit.attemptIds()) {
+		auto found = runs.constFind(id);
+		if (found == runs.constEnd())
+			continue;
+		const SingleRun &run = found.value();
+		QByteArray started = json ? jsonString(run.timeLabel) : csvString(run.timeLabel);
+
+		RunningTotal total;
+		for (int sidx = 0; sidx < run.splits.size(); sidx++) {
+			const SingleSplit &split = run.splits[sidx];
+			bool totalHas = total.add(split);
+			const QByteArray &name = sidx < encodedNames.size() ? encodedNames[sidx] : emptyName;
+
+			if (json) {
+				writer.literal("{\"attempt_id\":");
+				writer.signedNumber(id);
+				writer.literal(",\"started\":");
+				writer.write(started);
+				writer.literal(",\"segment_index\":");
+				writer.number(sidx);
+				writer.literal(",\"segment_name\":");
+				writer.write(name);
+				writer.literal(",\"split_us\":");
+				if (split.splitHas) writer.number(split.splitUs); else writer.literal("null");
+				writer.literal(",\"total_us\":");
+				if (totalHas) writer.number(total.us); else writer.literal("null");
+				if (split.splitHas) writer.literal(",\"skipped\":false}\n"); else writer.literal(",\"skipped\":true}\n");
+			} else {
+				writer.signedNumber(id);
+				writer.put(',');
+				writer.write(started);
+				writer.put(',');
+				writer.number(sidx);
+				writer.put(',');
+				writer.write(name);
+				writer.put(',');
+				if (split.splitHas) writer.number(split.splitUs);
+				writer.put(',');
+				if (totalHas) writer.number(total.us);
+				if (split.splitHas) writer.literal(",0\n"); else writer.literal(",1\n");
+			}
+			rows++;
+		}
+	}
+	writer.flush();
+	return writer.ok() ? rows : -1;
+}
@@ -0,0 +1,21 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <QIODevice>
+
+class XmlEdit;
+
+enum ExportFormat {
+    EXPORT_CSV,
+    EXPORT_JSON_LINES,
+};
+
+// .jsonl and .ndjson export JSON Lines, anything else CSV
+ExportFormat exportFormatForPath(const QString &fileName);
+
+// Write one row per attempt x recorded segment:
+//     attempt id, started, segment index, segment name, split us, total us, skipped
+// Rows are formatted straight into a byte buffer from the parsed runs. Returns rows written, or -1 on IO error
+qint64 exportRuns(const XmlEdit &edit, QIODevice *out, ExportFormat format);
+
+#endif
@@ -0,0 +1,82 @@
+#include "importer.h"
+#include "xmledit.h"
+#include <QIODevice>
+#include <QCoreApplication>
+
+#define IMPORT_TR(s) QCoreApplication::translate("Importer", s)
+
+// Split one line into cells. Cells may be "double quoted", with "" for a literal quote
+static QStringList splitCells(const QString &line, QChar delimiter) {
+	QStringList cells;
+	QString cell;
+	bool quoted = false;
+	for (int idx = 0; idx < line.size(); idx++) {
+		QChar c = line[idx];
+		if (quoted) {
+			if (c == '"') {
+				if (idx + 1 < line.size() && line[idx+1] == '"') {
+					cell += c;
+					idx++;
+				} else {
+					quoted = false;
+				}
+			} else {
+				cell += c;
+			}
+		} else if (c == '"') {
+			quoted = true;
+		} else if (c == delimiter) {
+			cells.append(cell.trimmed());
+			cell.clear();
+		} else {
+			cell += c;
+		}
+	}
+	cells.append(cell.trimmed());
+	return cells;
+}
+
+bool parseImport(QIODevice *in, int segmentCount, QVector<ImportedAttempt> &attempts, QString *errorString) {
+	attempts.clear();
+	int lineNumber = 0;
+	while (!in->atEnd()) {
+		QString line = QString::fromUtf8(in->readLine());
+		lineNumber++;
+		while (line.endsWith('\n') || line.endsWith('\r'))
+			line.chop(1);
+		if (line.trimmed().isEmpty() || line.startsWith('#'))
+			continue;
+
+		QStringList cells = splitCells(line, line.contains('\t') ? QChar('\t') : QChar(','));
+		if (attempts.isEmpty() && cells[0].compare("started", Qt::CaseInsensitive) == 0)
+			continue; // Header
+		while (cells.size() > 1 && cells.last().isEmpty()) // Trailing empty cells are segments never reached
+			cells.removeLast();
+
+		if (cells.size() - 1 > segmentCount) {
+			*errorString = IMPORT_TR("Line %1 has %2 split times, but there are only %3 segments")
+				.arg(lineNumber).arg(cells.size() - 1).arg(segmentCount);
+			attempts.clear();
+			return false;
+		}
+
+		ImportedAttempt attempt;
+		attempt.started = cells[0];
+		attempt.splits.reserve(cells.size() - 1);
+		for (int cidx = 1; cidx < cells.size(); cidx++) {
+			ImportedSplit split = {false, 0};
+			if (!cells[cidx].isEmpty()) {
+				split.us = strToUs(cells[cidx], &split.has);
+				if (!split.has) {
+					*errorString = IMPORT_TR("Line %1, split %2: couldn't parse time \"%3\"")
+						.arg(lineNumber).arg(cidx).arg(cells[cidx]);
+					attempts.clear();
+					return false;
+				}
+			}
+			attempt.splits.append(split);
+		}
+		attempts.append(attempt);
+	}
+	return true;
+}
@@ -0,0 +1,27 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include <QVector>
+#include <QString>
+
+class QIODevice;
+
+struct ImportedSplit {
+    bool has; // False if the split was skipped
+    uint64_t us;
+};
+
+// One row of an import file. Splits stop at the last segment reached, so a reset run is short
+struct ImportedAttempt {
+    QString started;
+    QVector<ImportedSplit> splits;
+};
+
+// Read CSV or TSV (picked per line by whether it contains a tab) where each row is
+//     started, split time 1, split time 2, ...
+// Times are in the same forms the tables accept; an empty cell is a skipped split.
+// A first row starting with "started" is a header, and lines starting with # are comments.
+// Nothing is returned unless every row is valid; otherwise errorString names the first bad one.
+bool parseImport(QIODevice *in, int segmentCount, QVector<ImportedAttempt> &attempts, QString *errorString);
+
+#endif
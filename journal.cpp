@@ -0,0 +1,137 @@
+#include "journal.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+
+#define JOURNAL_MAGIC 0x53454a31 // "SEJ1"
+
+// The journal is only meaningful against the exact file it was recorded on top of,
+// so the header records that file's size and modification time
+static void documentStamp(const QString &documentPath, qint64 &size, qint64 &modified) {
+	QFileInfo info(documentPath);
+	size = info.size();
+	modified = info.lastModified().toMSecsSinceEpoch();
+}
+
+QString EditJournal::pathFor(const QString &documentPath) {
+	return documentPath + ".journal";
+}
+
+bool EditJournal::flush(const QString &documentPath) {
+	if (stale) {
+		discard(documentPath);
+		stale = false;
+	}
+	if (pending.isEmpty())
+		return true;
+
+	QFile file(pathFor(documentPath));
+	if (!file.open(QFile::WriteOnly | QFile::Append))
+		return false;
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_5_0);
+	if (file.size() == 0) { // New journal
+		qint64 size, modified;
+		documentStamp(documentPath, size, modified);
+		out << quint32(JOURNAL_MAGIC) << size << modified;
+	}
+	for(const JournalEdit &edit : pending)
+		out << edit.runId << edit.row << edit.column << quint8(edit.present) << edit.us;
+
+	if (out.status() != QDataStream::Ok || !file.flush())
+		return false;
+	pending.clear();
+	return true;
+}
+
+bool EditJournal::read(const QString &documentPath, QVector<JournalEdit> &edits) {
+	edits.clear();
+	QFile file(pathFor(documentPath));
+	if (!file.open(QFile::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_5_0);
+	quint32 magic;
+	qint64 size, modified, expectSize, expectModified;
+	in >> magic >> size >> modified;
+	documentStamp(documentPath, expectSize, expectModified);
+	if (in.status() != QDataStream::Ok || magic != JOURNAL_MAGIC
+		|| size != expectSize || modified != expectModified)
+		return false; // Corrupt, or the document changed since the journal was started
+
+	while (!in.atEnd()) {
+		JournalEdit edit;
+		quint8 present;
+		in >> edit.runId >> edit.row >> edit.column >> present >> edit.us;
+		if (in.status() != QDataStream::Ok) // A record cut off by the crash, drop it
+			break;
+		edit.present = present;
+		edits.append(edit);
+	}
+	return !edits.isEmpty();
+}
+
+void EditJournal::discard(const QString &documentPath) {
+	QFile::remove(pathFor(documentPath));
+}
+
+void UndoHistory::push(const QVector<UndoEdit> &group) {
+	if (replaying || group.isEmpty())
+		return;
+	undone = QVector<UndoEdit>(); // clear() would keep the memory
+	undoneGroups = QVector<int>();
+	doneGroups.append(done.size());
+	done += group;
+	trim();
+}
+
+bool UndoHistory::take(QVector<UndoEdit> &from, QVector<int> &fromGroups, QVector<UndoEdit> &to, QVector<int> &toGroups, QVector<UndoEdit> &group) {
+	if (fromGroups.isEmpty())
+		return false;
+	int first = fromGroups.takeLast();
+	group = from.mid(first);
+	from.resize(first);
+	toGroups.append(to.size());
+	to += group;
+	return true;
+}
+
+void UndoHistory::clear() {
+	done = undone = QVector<UndoEdit>();
+	doneGroups = undoneGroups = QVector<int>();
+}
+
+// What the stacks have allocated, not just what's in them
+qint64 UndoHistory::bytes() const {
+	return qint64(done.capacity() + undone.capacity()) * sizeof(UndoEdit)
+		+ qint64(doneGroups.capacity() + undoneGroups.capacity()) * sizeof(int);
+}
+
+// Forget the oldest groups until the history fits. It goes down to 3/4 of the limit,
+// so a long session trims now and then rather than on every edit.
+void UndoHistory::trim() {
+	if (bytes() <= limitBytes)
+		return;
+	qint64 target = limitBytes / 4 * 3;
+	qint64 size = qint64(done.size() + undone.size()) * sizeof(UndoEdit) + qint64(doneGroups.size() + undoneGroups.size()) * sizeof(int);
+	int groups = 0;
+	while (groups < doneGroups.size() && size > target) {
+		int end = groups + 1 < doneGroups.size() ? doneGroups[groups + 1] : done.size();
+		size -= qint64(end - doneGroups[groups]) * sizeof(UndoEdit) + sizeof(int);
+		groups++;
+	}
+	int first = groups < doneGroups.size() ? doneGroups[groups] : done.size();
+	done.remove(0, first);
+	doneGroups.remove(0, groups);
+	for (int &start : doneGroups)
+		start -= first;
+	if (size > target) { // Only redo is left, and it's too big on its own
+		undone = QVector<UndoEdit>();
+		undoneGroups = QVector<int>();
+	}
+	done.squeeze();
+	doneGroups.squeeze();
+}
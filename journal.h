@@ -0,0 +1,88 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QVector>
+#include <QString>
+
+// Run ids for the two tables that aren't attempts. LiveSplit attempt ids are positive.
+#define RUN_ID_PERSONAL_BEST (-1)
+#define RUN_ID_BEST_SPLITS (-2)
+
+// One table cell edit, as accepted by XmlEditTableWatcher::changed
+struct JournalEdit {
+    qint64 runId;
+    qint32 row;
+    quint8 column; // Run table column, 1 for split or 2 for total
+    bool present; // False if the cell was cleared
+    quint64 us;
+};
+
+// Autosave journal. Edits pile up in memory and every few seconds get appended to a
+// file next to the document, so after a crash they can be replayed onto the last save
+// instead of needing the whole document to have been serialized.
+class EditJournal {
+protected:
+    QVector<JournalEdit> pending;
+    bool stopped = false; // See stop()
+    bool stale = false; // The journal file must be deleted at the next flush
+
+public:
+    void record(const JournalEdit &edit) { if (!stopped) pending.append(edit); }
+    bool hasPending() const { return !pending.isEmpty() || stale; }
+    void reset() { pending.clear(); stopped = stale = false; }
+    // For changes the journal can't describe, like imported attempts or reordered segments.
+    // Replaying it onto the last save would no longer line up, so the file goes at the next
+    // flush and nothing more is recorded until the document is saved.
+    void stop() { pending.clear(); stopped = stale = true; }
+    bool isStopped() const { return stopped; }
+
+    // Append pending edits to the journal for documentPath. Returns false on IO error
+    bool flush(const QString &documentPath);
+
+    static QString pathFor(const QString &documentPath);
+    // Fills edits and returns true if documentPath has a journal written against its current contents
+    static bool read(const QString &documentPath, QVector<JournalEdit> &edits);
+    static void discard(const QString &documentPath);
+};
+
+// One table cell edit with the value it replaced, so it can go either way
+struct UndoEdit {
+    qint64 runId;
+    qint32 row;
+    quint8 column; // Run table column, 1 for split or 2 for total
+    quint8 presence; // UNDO_OLD_PRESENT and UNDO_NEW_PRESENT, for cells that weren't cleared
+    quint64 oldUs;
+    quint64 newUs;
+};
+#define UNDO_OLD_PRESENT 1
+#define UNDO_NEW_PRESENT 2
+
+// Undo and redo stacks. An edit, a paste or a bulk adjustment is one group, undone together.
+// Only changed cell values are kept, and once they take more than the memory limit the
+// oldest groups are forgotten.
+class UndoHistory {
+protected:
+    QVector<UndoEdit> done, undone; // Oldest group first
+    QVector<int> doneGroups, undoneGroups; // Index of each group's first edit
+    bool replaying = false;
+    qint64 limitBytes = 4096*1024;
+
+    qint64 bytes() const;
+    void trim();
+
+public:
+    void push(const QVector<UndoEdit> &group); // Also forgets what was undone
+    // Move the latest group to the other stack and return it. False if there is none
+    bool takeUndo(QVector<UndoEdit> &group) { return take(done, doneGroups, undone, undoneGroups, group); }
+    bool takeRedo(QVector<UndoEdit> &group) { return take(undone, undoneGroups, done, doneGroups, group); }
+    bool canUndo() const { return !doneGroups.isEmpty(); }
+    bool canRedo() const { return !undoneGroups.isEmpty(); }
+    void clear();
+    void setReplaying(bool r) { replaying = r; } // While an undo is applied, its edits aren't pushed
+    void setLimit(qint64 bytes) { limitBytes = bytes; trim(); }
+
+protected:
+    static bool take(QVector<UndoEdit> &from, QVector<int> &fromGroups, QVector<UndoEdit> &to, QVector<int> &toGroups, QVector<UndoEdit> &group);
+};
+
+#endif
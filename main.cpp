@@ -52,8 +52,162 @@
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
+#include <QSaveFile>
+#include <stdio.h>
 
 #include "mainwindow.h"
+#include "exporter.h"
+#include "sqlsync.h"
+#include "singleinstance.h"
+#include "queryserver.h"
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#define QUERY_TEST_TIMEOUT_MS 2000
+
+// Command line tools parse without building any tables
+static bool readForCommandLine(XmlEdit &xmlEdit, const QString &input)
+{
+    xmlEdit.setRenderEnabled(false);
+    QString errorString;
+    if (!xmlEdit.readFile(input, &errorString)) { // With rendering off, parse errors come back here too
+        fprintf(stderr, "Cannot read file %s: %s\n", qPrintable(input), qPrintable(errorString));
+        return false;
+    }
+    return true;
+}
+
+// --export: write the rows
+static int exportFromCommandLine(const XmlEdit &xmlEdit, const QString &output)
+{
+    QSaveFile file(output);
+    qint64 rows = -1;
+    if (file.open(QFile::WriteOnly))
+        rows = exportRuns(xmlEdit, &file, exportFormatForPath(output));
+    if (rows < 0 || !file.commit()) {
+        fprintf(stderr, "Cannot write file %s: %s\n", qPrintable(output), qPrintable(file.errorString()));
+        return 1;
+    }
+    printf("Exported %lld rows to %s\n", rows, qPrintable(output));
+    return 0;
+}
+
+// --sync: add new attempts to a SQLite database
+static int syncFromCommandLine(const XmlEdit &xmlEdit, const QString &database)
+{
+    QString errorString;
+    qint64 added = syncToDatabase(xmlEdit, database, &errorString);
+    if (added < 0) {
+        fprintf(stderr, "Cannot sync to database %s: %s\n", qPrintable(database), qPrintable(errorString));
+        return 1;
+    }
+    printf("Added %lld attempts to %s\n", added, qPrintable(database));
+    return 0;
+}
+
+// --clean-history-dry-run: list what Clean Up History would remove
+static int listGarbageFromCommandLine(const XmlEdit &xmlEdit)
+{
+    QVector<HistoryGarbage> garbage = xmlEdit.findGarbage();
+    qint64 bytes = 0;
+    for (const HistoryGarbage &entry : garbage) {
+        printf("%s\n", qPrintable(entry.description));
+        bytes += entry.bytes;
+    }
+    printf("%d entries, about %lld bytes\n", garbage.size(), bytes);
+    return 0;
+}
+
+// One GET to the query server, the way an overlay makes it. Returns the HTTP status, or -1
+static int queryGet(quint16 port, const char *route, QJsonObject *body)
+{
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, port);
+    if (!socket.waitForConnected(QUERY_TEST_TIMEOUT_MS))
+        return -1;
+    socket.write(QByteArray("GET ") + route + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    QByteArray response;
+    while (socket.state() == QAbstractSocket::ConnectedState && socket.waitForReadyRead(QUERY_TEST_TIMEOUT_MS))
+        response += socket.readAll();
+    response += socket.readAll();
+
+    int headerEnd = response.indexOf("\r\n\r\n");
+    QList<QByteArray> statusLine = response.left(response.indexOf("\r\n")).split(' ');
+    if (headerEnd < 0 || statusLine.size() < 2)
+        return -1;
+    *body = QJsonDocument::fromJson(response.mid(headerEnd + 4)).object();
+    return statusLine[1].toInt();
+}
+
+// --query-test: serve the file on a free port, ask for every route as an overlay would, and
+// check the answers against the file
+static int queryTestFromCommandLine(const XmlEdit &xmlEdit)
+{
+    QueryServer server;
+    QString errorString;
+    if (!server.start(0, &errorString)) {
+        fprintf(stderr, "Cannot start the query server: %s\n", qPrintable(errorString));
+        return 1;
+    }
+    server.publish(takeQuerySnapshot(xmlEdit)); // Queued ahead of the requests below
+
+    const QStringList &names = xmlEdit.segmentNames();
+    const SingleRun &golds = xmlEdit.bestSegments();
+    QVector<int> counts(names.size(), 0);
+    for (const SingleRun &run : xmlEdit.attemptRuns())
+        for (int sidx = 0; sidx < run.splits.size() && sidx < names.size(); sidx++)
+            if (run.splits[sidx].valid() && run.splits[sidx].splitHas)
+                counts[sidx]++;
+
+    int failures = 0;
+    auto check = [&failures](const char *route, bool ok, const QString &why) {
+        printf("%s %s%s\n", ok ? "ok    " : "FAILED", route, ok ? "" : qPrintable(": " + why));
+        if (!ok)
+            failures++;
+    };
+    for (const char *route : {"/splits", "/pb", "/golds", "/sum-of-best", "/stats"}) {
+        QJsonObject body;
+        int status = queryGet(server.port(), route, &body);
+        if (status != 200) {
+            check(route, false, QString("status %1").arg(status));
+            continue;
+        }
+        QJsonArray segments = body.value("segments").toArray();
+        QString why;
+        if (body.value("timing").toString() != (xmlEdit.timing() == TIMING_GAME ? "GameTime" : "RealTime"))
+            why = "wrong timing method";
+        else if (strcmp(route, "/pb") == 0 && !body.contains("total_us"))
+            why = "no total_us";
+        else if (strcmp(route, "/sum-of-best") == 0 && !body.contains("sum_of_best_us"))
+            why = "no sum_of_best_us";
+        else if (strcmp(route, "/sum-of-best") && segments.size() != names.size())
+            why = QString("%1 segments, the file has %2").arg(segments.size()).arg(names.size());
+        for (int sidx = 0; why.isEmpty() && sidx < segments.size(); sidx++) {
+            QJsonObject segment = segments[sidx].toObject();
+            const SingleSplit *gold = sidx < golds.splits.size() ? &golds.splits[sidx] : NULL;
+            bool goldHas = gold && gold->valid() && gold->splitHas;
+            if (segment.value("name").toString() != names[sidx])
+                why = QString("segment %1 is named \"%2\"").arg(sidx + 1).arg(segment.value("name").toString());
+            else if (strcmp(route, "/golds") == 0 && (goldHas ? segment.value("gold_us").toDouble() != double(gold->splitUs) : !segment.value("gold_us").isNull()))
+                why = QString("gold for segment %1 doesn't match").arg(sidx + 1);
+            else if (strcmp(route, "/stats") == 0 && segment.value("count").toInt() != counts[sidx])
+                why = QString("segment %1 has %2 times, the file has %3").arg(sidx + 1).arg(segment.value("count").toInt()).arg(counts[sidx]);
+        }
+        if (strcmp(route, "/stats") == 0 && why.isEmpty() && body.value("attempts").toInt() != xmlEdit.attemptIds().size())
+            why = "wrong attempt count";
+        check(route, why.isEmpty(), why);
+    }
+    QJsonObject body;
+    int status = queryGet(server.port(), "/nowhere", &body);
+    check("/nowhere", status == 404, QString("status %1, not 404").arg(status));
+
+    server.stop();
+    printf("%d of 6 checks failed\n", failures);
+    return failures ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -68,11 +222,58 @@ int main(int argc, char *argv[])
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addPositionalArgument("file", "The file to open.");
+    QCommandLineOption exportOption("export", "Export every attempt in file to <output> (.csv or .jsonl) and exit.", "output");
+    parser.addOption(exportOption);
+    QCommandLineOption syncOption("sync", "Add attempts in file that are newer than any in SQLite <database> and exit.", "database");
+    parser.addOption(syncOption);
+    QCommandLineOption cleanDryRunOption("clean-history-dry-run", "List the segment history entries \"Clean Up History\" would remove from file and exit.");
+    parser.addOption(cleanDryRunOption);
+    QCommandLineOption queryTestOption("query-test", "Serve file to overlays on a free port, request every route, check the answers and exit.");
+    parser.addOption(queryTestOption);
+    QCommandLineOption gameTimeOption("game-time", "With --export or --sync, use game time instead of real time.");
+    parser.addOption(gameTimeOption);
+    QCommandLineOption newInstanceOption("new-instance", "Open a new window even if SplitEdit is already running.");
+    parser.addOption(newInstanceOption);
     parser.process(app);
 
+    if (parser.isSet(exportOption) || parser.isSet(syncOption) || parser.isSet(cleanDryRunOption) || parser.isSet(queryTestOption)) {
+        if (parser.positionalArguments().isEmpty()) {
+            fprintf(stderr, "--export, --sync, --clean-history-dry-run and --query-test need a file to read\n");
+            return 1;
+        }
+        XmlEdit xmlEdit;
+        if (parser.isSet(gameTimeOption))
+            xmlEdit.setTimingMethod(TIMING_GAME);
+        if (!parser.isSet(cleanDryRunOption)) // Export, sync and the query test only need the times, so read them the quick way
+            xmlEdit.setReadOnly(true);
+        if (!readForCommandLine(xmlEdit, parser.positionalArguments().first()))
+            return 1;
+        if (parser.isSet(exportOption) && exportFromCommandLine(xmlEdit, parser.value(exportOption)))
+            return 1;
+        if (parser.isSet(syncOption) && syncFromCommandLine(xmlEdit, parser.value(syncOption)))
+            return 1;
+        if (parser.isSet(queryTestOption) && queryTestFromCommandLine(xmlEdit))
+            return 1;
+        if (parser.isSet(cleanDryRunOption))
+            return listGarbageFromCommandLine(xmlEdit);
+        return 0;
+    }
+
+    // If SplitEdit is already running, it opens the file, and this process is done before
+    // building any window
+    QString fileName = parser.positionalArguments().isEmpty() ? QString() : parser.positionalArguments().first();
+    SingleInstance instance;
+    if (!parser.isSet(newInstanceOption)) {
+        if (SingleInstance::forward(fileName))
+            return 0;
+        if (!instance.listen() && SingleInstance::forward(fileName)) // Another launch started listening in between
+            return 0;
+    }
+
     MainWindow mainWin;
-    if (!parser.positionalArguments().isEmpty())
-        mainWin.loadFile(parser.positionalArguments().first());
+    QObject::connect(&instance, &SingleInstance::openRequested, &mainWin, &MainWindow::openRequested);
+    if (!fileName.isEmpty())
+        mainWin.loadFile(fileName);
     mainWin.show();
     return app.exec();
 }
@@ -50,13 +50,24 @@
 
 //! [0]
 #include <QtWidgets>
+#include <climits>
 
 #include "mainwindow.h"
+#include "archive.h"
+#include "exporter.h"
+#include "sqlsync.h"
+#include "importer.h"
+#include "segmenteditor.h"
+#include "queryserver.h"
+#include "segmentchart.h"
 //! [0]
 
 //! [1]
 MainWindow::MainWindow()
-    : xmlEdit(new XmlEdit)
+    : xmlEdit(new XmlEdit), autosaveTimer(new QTimer(this)), saver(NULL), backupCount(3),
+      fileWatcher(new QFileSystemWatcher(this)), reloadTimer(new QTimer(this)), knownSize(-1),
+      queryServer(new QueryServer(this)), snapshotTimer(new QTimer(this)), queryPort(16835),
+      sortSegment(0)
 //! [1] //! [2]
 {
     setCentralWidget(xmlEdit);
@@ -68,6 +79,20 @@ MainWindow::MainWindow()
 
     connect(xmlEdit, &XmlEdit::contentsChanged,
             this, &MainWindow::documentWasModified);
+    connect(autosaveTimer, &QTimer::timeout, this, &MainWindow::autosave);
+    autosaveTimer->start();
+
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(500);
+    connect(fileWatcher, &QFileSystemWatcher::fileChanged, reloadTimer, QOverload<>::of(&QTimer::start));
+    connect(reloadTimer, &QTimer::timeout, this, &MainWindow::liveReload);
+
+    // Overlays get a new snapshot once a burst of edits is over
+    snapshotTimer->setSingleShot(true);
+    snapshotTimer->setInterval(200);
+    connect(xmlEdit, &XmlEdit::dataChanged, snapshotTimer, QOverload<>::of(&QTimer::start));
+    connect(snapshotTimer, &QTimer::timeout, this, &MainWindow::publishSnapshot);
+    connect(snapshotTimer, &QTimer::timeout, this, &MainWindow::updateChart);
 
 #ifndef QT_NO_SESSIONMANAGER
     QGuiApplication::setFallbackSessionManagementEnabled(false);
@@ -85,6 +110,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
 //! [3] //! [4]
 {
     if (maybeSave()) {
+        finishSave();
         writeSettings();
         event->accept();
     } else {
@@ -98,6 +124,7 @@ void MainWindow::newFile()
 //! [5] //! [6]
 {
     if (maybeSave()) {
+        finishSave();
         xmlEdit->clear();
         setCurrentFile(QString());
     }
@@ -109,13 +136,33 @@ void MainWindow::open()
 //! [7] //! [8]
 {
     if (maybeSave()) {
-        QString fileName = QFileDialog::getOpenFileName(this);
+        QString fileName = QFileDialog::getOpenFileName(this, QString(), QString(),
+            tr("LiveSplit splits (*.lss *.lssz);;All files (*)"));
         if (!fileName.isEmpty())
             loadFile(fileName);
     }
 }
 //! [8]
 
+// A launch that found us running handed over its file. If that's the file already open and
+// it hasn't changed on disk, the document in memory is as good as reading it again.
+void MainWindow::openRequested(const QString &fileName)
+{
+    if (isMinimized())
+        showNormal();
+    raise();
+    activateWindow();
+    if (fileName.isEmpty())
+        return;
+
+    QFileInfo info(fileName);
+    if (!curFile.isEmpty() && info.canonicalFilePath() == QFileInfo(curFile).canonicalFilePath()
+        && info.size() == knownSize && info.lastModified() == knownModified)
+        return;
+    if (maybeSave())
+        loadFile(fileName);
+}
+
 //! [9]
 bool MainWindow::save()
 //! [9] //! [10]
@@ -136,6 +183,378 @@ void MainWindow::revert()
     }
 }
 
+// One row per attempt and segment, for spreadsheets and analysis scripts
+void MainWindow::exportAttempts()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Attempts"), QString(),
+        tr("CSV (*.csv);;JSON Lines (*.jsonl)"));
+    if (fileName.isEmpty())
+        return;
+
+    QSaveFile file(fileName);
+    qint64 rows = -1;
+    if (file.open(QFile::WriteOnly))
+        rows = exportRuns(*xmlEdit, &file, exportFormatForPath(fileName));
+    if (rows < 0 || !file.commit()) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(QDir::toNativeSeparators(fileName),
+                                  file.errorString()));
+        return;
+    }
+    statusBar()->showMessage(tr("Exported %1 rows to %2").arg(rows).arg(strippedName(fileName)), 5000);
+}
+
+// Rows are checked before anything is added, so a bad file changes nothing
+void MainWindow::importAttempts()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import Attempts"), QString(),
+        tr("CSV or TSV (*.csv *.tsv *.txt);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot read file %1:\n%2.")
+                             .arg(QDir::toNativeSeparators(fileName),
+                                  file.errorString()));
+        return;
+    }
+
+    QVector<ImportedAttempt> attempts;
+    QString errorString;
+    int added = -1;
+    if (parseImport(&file, xmlEdit->segmentNames().size(), attempts, &errorString))
+        added = xmlEdit->appendAttempts(attempts, &errorString);
+    if (added < 0) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot import %1:\n%2.")
+                             .arg(QDir::toNativeSeparators(fileName), errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Imported %1 attempts").arg(added), 5000);
+}
+
+// For when a game patch changes a load, or times were recorded with the wrong timer speed
+void MainWindow::adjustTimes()
+{
+    enum { ADD, SUBTRACT, MULTIPLY };
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Adjust Times"));
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QComboBox *segmentBox = new QComboBox(&dialog);
+    segmentBox->addItem(tr("All segments"));
+    segmentBox->addItems(xmlEdit->segmentNames());
+    form->addRow(tr("Segment:"), segmentBox);
+
+    QComboBox *operationBox = new QComboBox(&dialog);
+    operationBox->addItem(tr("Add"));
+    operationBox->addItem(tr("Subtract"));
+    operationBox->addItem(tr("Multiply by"));
+    QLineEdit *valueEdit = new QLineEdit(&dialog);
+    valueEdit->setPlaceholderText(tr("Time, or factor to multiply by"));
+    QHBoxLayout *operationLayout = new QHBoxLayout;
+    operationLayout->addWidget(operationBox);
+    operationLayout->addWidget(valueEdit);
+    form->addRow(tr("Change:"), operationLayout);
+
+    QCheckBox *recordsBox = new QCheckBox(tr("Also change the Personal Best and Best Splits"), &dialog);
+    recordsBox->setChecked(true);
+    form->addRow(recordsBox);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    TimeTransform transform;
+    transform.segment = segmentBox->currentIndex() - 1;
+    transform.includeRecords = recordsBox->isChecked();
+    bool success;
+    if (operationBox->currentIndex() == MULTIPLY) {
+        double factor = valueEdit->text().toDouble(&success);
+        success = success && factor > 0 && factor < 1000;
+        transform.scalePpm = quint64(qRound64(factor * 1000000));
+        success = success && transform.scalePpm > 0; // Too small a factor would zero every time
+    } else {
+        uint64_t us = strToUs(valueEdit->text(), &success);
+        success = success && us <= quint64(LLONG_MAX);
+        transform.shiftUs = operationBox->currentIndex() == SUBTRACT ? -qint64(us) : qint64(us);
+    }
+    if (!success) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Couldn't understand \"%1\".").arg(valueEdit->text()));
+        return;
+    }
+
+    QString errorString;
+    qint64 changed = xmlEdit->transformTimes(transform, &errorString);
+    if (changed < 0) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot adjust times:\n%1.").arg(errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Adjusted %1 split times").arg(changed), 5000);
+}
+
+void MainWindow::editSegments()
+{
+    SegmentEditor editor(xmlEdit->segmentNames(), this);
+    if (editor.exec() != QDialog::Accepted)
+        return;
+
+    QString errorString;
+    if (!xmlEdit->remapSegments(editor.layout(), &errorString))
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot change segments:\n%1.").arg(errorString));
+}
+
+void MainWindow::mergeSegments()
+{
+    const QStringList &names = xmlEdit->segmentNames();
+    if (names.size() < 2)
+        return;
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Merge Segments"));
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QComboBox *pairBox = new QComboBox(&dialog);
+    for (int idx = 0; idx + 1 < names.size(); idx++)
+        pairBox->addItem(tr("%1 + %2").arg(names[idx], names[idx+1]));
+    form->addRow(tr("Merge:"), pairBox);
+
+    QLineEdit *nameEdit = new QLineEdit(names[1], &dialog);
+    form->addRow(tr("New name:"), nameEdit);
+    connect(pairBox, QOverload<int>::of(&QComboBox::currentIndexChanged), nameEdit, [nameEdit, names](int idx) {
+        nameEdit->setText(names[idx+1]); // The split that remains is the second one's
+    });
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    QString errorString;
+    if (!xmlEdit->mergeSegments(pairBox->currentIndex(), nameEdit->text(), &errorString))
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot merge segments:\n%1.").arg(errorString));
+}
+
+void MainWindow::splitSegment()
+{
+    const QStringList &names = xmlEdit->segmentNames();
+    if (names.isEmpty())
+        return;
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Split Segment"));
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QComboBox *segmentBox = new QComboBox(&dialog);
+    segmentBox->addItems(names);
+    form->addRow(tr("Split:"), segmentBox);
+
+    QLineEdit *nameEdit = new QLineEdit(tr("New segment"), &dialog);
+    form->addRow(tr("First part's name:"), nameEdit);
+
+    QDoubleSpinBox *percentBox = new QDoubleSpinBox(&dialog);
+    percentBox->setRange(0, 100);
+    percentBox->setDecimals(1);
+    percentBox->setSuffix(tr("%"));
+    percentBox->setValue(50);
+    form->addRow(tr("First part's share:"), percentBox);
+
+    QCheckBox *fileBox = new QCheckBox(tr("Read first part times for some attempts from a file"), &dialog);
+    fileBox->setToolTip(tr("A CSV or TSV file of attempt id, first part time. Other attempts use the share above."));
+    form->addRow(fileBox);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    // Same reader as Import Attempts, with the attempt id where the start date would be
+    QHash<qint64, uint64_t> firstUs;
+    if (fileBox->isChecked()) {
+        QString fileName = QFileDialog::getOpenFileName(this, tr("First Part Times"), QString(),
+            tr("CSV or TSV (*.csv *.tsv *.txt);;All files (*)"));
+        if (fileName.isEmpty())
+            return;
+        QFile file(fileName);
+        QVector<ImportedAttempt> rows;
+        QString errorString;
+        if (!file.open(QFile::ReadOnly | QFile::Text))
+            errorString = file.errorString();
+        else if (parseImport(&file, 1, rows, &errorString)) {
+            for (const ImportedAttempt &row : rows) {
+                bool success;
+                qint64 id = row.started.toLongLong(&success);
+                if (!success) {
+                    errorString = tr("\"%1\" is not an attempt id").arg(row.started);
+                    break;
+                }
+                if (!row.splits.isEmpty() && row.splits[0].has)
+                    firstUs[id] = row.splits[0].us;
+            }
+        }
+        if (!errorString.isEmpty()) {
+            QMessageBox::warning(this, tr("XML editor"),
+                                 tr("Cannot read file %1:\n%2.")
+                                 .arg(QDir::toNativeSeparators(fileName), errorString));
+            return;
+        }
+    }
+
+    QString errorString;
+    quint64 firstPpm = quint64(qRound64(percentBox->value() * 10000));
+    if (!xmlEdit->splitSegment(segmentBox->currentIndex(), nameEdit->text(), firstPpm, firstUs, &errorString))
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot split segment:\n%1.").arg(errorString));
+}
+
+// Shows what findRepairs proposes, and applies the ones left checked
+void MainWindow::repairRuns()
+{
+    QVector<RunRepair> repairs = xmlEdit->findRepairs();
+    if (repairs.isEmpty()) {
+        QMessageBox::information(this, tr("Repair Runs"), tr("No runs need repairing."));
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Repair Runs"));
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(tr("%n run(s) can be repaired. Uncheck any you want left alone.", "", repairs.size()), &dialog));
+
+    QListWidget *list = new QListWidget(&dialog);
+    for (const RunRepair &repair : repairs) {
+        QListWidgetItem *item = new QListWidgetItem(repair.description, list);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Checked);
+    }
+    layout->addWidget(list);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    buttons->button(QDialogButtonBox::Ok)->setText(tr("Repair"));
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    QVector<RunRepair> chosen;
+    for (int row = 0; row < list->count(); row++)
+        if (list->item(row)->checkState() == Qt::Checked)
+            chosen.append(repairs[row]);
+    if (chosen.isEmpty())
+        return;
+
+    QString errorString;
+    if (!xmlEdit->applyRepairs(chosen, &errorString)) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot repair runs:\n%1.").arg(errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Repaired %n run(s)", "", chosen.size()), 5000);
+}
+
+// Lists everything findGarbage found, then removes it all if asked to
+void MainWindow::cleanUpHistory()
+{
+    QVector<HistoryGarbage> garbage = xmlEdit->findGarbage();
+    if (garbage.isEmpty()) {
+        QMessageBox::information(this, tr("Clean Up History"), tr("The segment history has nothing to clean up."));
+        return;
+    }
+    qint64 bytes = 0;
+    for (const HistoryGarbage &entry : garbage)
+        bytes += entry.bytes;
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Clean Up History"));
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(tr("%n segment history entries can be removed, making the file about %1 smaller.", "", garbage.size())
+                                 .arg(QLocale().formattedDataSize(bytes)), &dialog));
+
+    QListWidget *list = new QListWidget(&dialog);
+    for (const HistoryGarbage &entry : garbage)
+        list->addItem(entry.description);
+    layout->addWidget(list);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    buttons->button(QDialogButtonBox::Ok)->setText(tr("Remove"));
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    QString errorString;
+    qint64 reclaimed = xmlEdit->collectGarbage(&errorString);
+    if (reclaimed < 0) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot clean up history:\n%1.").arg(errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Removed %n entries, about %1", "", garbage.size()).arg(QLocale().formattedDataSize(reclaimed)), 5000);
+}
+
+void MainWindow::renumberAttempts()
+{
+    const QMessageBox::StandardButton ret
+        = QMessageBox::question(this, tr("Renumber Attempts"),
+                                tr("Number the %n attempt(s) 1, 2, 3... in the order they were started?\n"
+                                   "A database synced before renumbering has its attempts replaced the next time you sync to it, "
+                                   "so anything else that refers to them by number will need updating.",
+                                   "", xmlEdit->attemptIds().size()));
+    if (ret != QMessageBox::Yes)
+        return;
+
+    QString errorString;
+    if (!xmlEdit->compactIds(&errorString)) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot renumber attempts:\n%1.").arg(errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Renumbered %n attempt(s)", "", xmlEdit->attemptIds().size()), 5000);
+}
+
+// Incremental: only attempts newer than those already in the database are added
+void MainWindow::syncDatabase()
+{
+    QFileDialog dialog(this, tr("Sync to Database"), QString(), tr("SQLite databases (*.sqlite *.db);;All files (*)"));
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setOption(QFileDialog::DontConfirmOverwrite); // Syncing into an existing database is the point
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+    QString fileName = dialog.selectedFiles().first();
+
+    QString errorString;
+    qint64 added = syncToDatabase(*xmlEdit, fileName, &errorString);
+    if (added < 0) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot sync to database %1:\n%2.")
+                             .arg(QDir::toNativeSeparators(fileName), errorString));
+        return;
+    }
+    statusBar()->showMessage(tr("Added %1 attempts to %2").arg(added).arg(strippedName(fileName)), 5000);
+}
+
 //! [11]
 bool MainWindow::saveAs()
 //! [11] //! [12]
@@ -143,9 +562,18 @@ bool MainWindow::saveAs()
     QFileDialog dialog(this);
     dialog.setWindowModality(Qt::WindowModal);
     dialog.setAcceptMode(QFileDialog::AcceptSave);
+    // Plain .lss is what LiveSplit reads; .lssz is our compressed archive format
+    const QString plainFilter = tr("LiveSplit splits (*.lss)");
+    const QString archiveFilter = tr("Compressed splits archive (*.lssz)");
+    dialog.setNameFilters(QStringList() << plainFilter << archiveFilter << tr("All files (*)"));
+    if (isArchivePath(curFile))
+        dialog.selectNameFilter(archiveFilter);
     if (dialog.exec() != QDialog::Accepted)
         return false;
-    return saveFile(dialog.selectedFiles().first());
+    QString fileName = dialog.selectedFiles().first();
+    if (QFileInfo(fileName).suffix().isEmpty()) // Name filters don't add the suffix by themselves
+        fileName += dialog.selectedNameFilter() == archiveFilter ? "." ARCHIVE_SUFFIX : ".lss";
+    return saveFile(fileName);
 }
 //! [12]
 
@@ -167,6 +595,16 @@ void MainWindow::documentWasModified()
 }
 //! [16]
 
+// Append edits made since the last autosave to the journal beside the file
+void MainWindow::autosave()
+{
+    if (curFile.isEmpty() || saver || !xmlEdit->editJournal().hasPending())
+        return;
+    if (!xmlEdit->editJournal().flush(curFile))
+        statusBar()->showMessage(tr("Could not write autosave journal for %1")
+                                 .arg(QDir::toNativeSeparators(EditJournal::pathFor(curFile))), 5000);
+}
+
 //! [17]
 void MainWindow::createActions()
 //! [17] //! [18]
@@ -210,6 +648,34 @@ void MainWindow::createActions()
     QAction *revertAct = fileMenu->addAction(tr("Revert"), this, &MainWindow::revert);
     revertAct->setStatusTip(tr("Revert the document"));
 
+    readOnlyAct = fileMenu->addAction(tr("&Read-Only Viewer"));
+    readOnlyAct->setCheckable(true);
+    readOnlyAct->setStatusTip(tr("Open files for looking at only, which takes much less memory"));
+    connect(readOnlyAct, &QAction::toggled, this, &MainWindow::setReadOnly);
+
+    liveReloadAct = fileMenu->addAction(tr("&Live Reload"));
+    liveReloadAct->setCheckable(true);
+    liveReloadAct->setStatusTip(tr("Add new attempts as soon as the timer writes them to the file"));
+    connect(liveReloadAct, &QAction::toggled, this, [this]() {
+        setCurrentFile(curFile); // Starts or stops watching
+    });
+
+    fileMenu->addSeparator();
+
+    QAction *importAct = fileMenu->addAction(tr("&Import Attempts..."), this, &MainWindow::importAttempts);
+    importAct->setStatusTip(tr("Add attempts recorded elsewhere from a CSV or TSV file"));
+
+    QAction *exportAct = fileMenu->addAction(tr("&Export Attempts..."), this, &MainWindow::exportAttempts);
+    exportAct->setStatusTip(tr("Export every split of every attempt as CSV or JSON Lines"));
+
+    QAction *syncAct = fileMenu->addAction(tr("Sync to &Database..."), this, &MainWindow::syncDatabase);
+    syncAct->setStatusTip(tr("Add attempts not yet stored to a SQLite database"));
+
+    queryServerAct = fileMenu->addAction(tr("Serve to &Overlays"));
+    queryServerAct->setCheckable(true);
+    queryServerAct->setStatusTip(tr("Answer queries for splits, golds and stats from stream overlays on this computer"));
+    connect(queryServerAct, &QAction::toggled, this, &MainWindow::setQueryServer);
+
 //! [20]
 
     fileMenu->addSeparator();
@@ -224,6 +690,21 @@ void MainWindow::createActions()
     QMenu *editMenu = menuBar()->addMenu(tr("&Edit"));
     //QToolBar *editToolBar = addToolBar(tr("Edit"));
 //!
+    const QIcon undoIcon = QIcon::fromTheme("edit-undo");
+    QAction *undoAct = editMenu->addAction(undoIcon, tr("&Undo"), xmlEdit, &XmlEdit::undo);
+    undoAct->setShortcuts(QKeySequence::Undo);
+    undoAct->setStatusTip(tr("Undo the last edit"));
+    undoAct->setEnabled(false);
+    connect(xmlEdit, &XmlEdit::undoAvailable, undoAct, &QAction::setEnabled);
+
+    const QIcon redoIcon = QIcon::fromTheme("edit-redo");
+    QAction *redoAct = editMenu->addAction(redoIcon, tr("&Redo"), xmlEdit, &XmlEdit::redo);
+    redoAct->setShortcuts(QKeySequence::Redo);
+    redoAct->setStatusTip(tr("Redo the last edit undone"));
+    redoAct->setEnabled(false);
+    connect(xmlEdit, &XmlEdit::redoAvailable, redoAct, &QAction::setEnabled);
+
+    editMenu->addSeparator();
 #ifndef QT_NO_CLIPBOARD
     const QIcon cutIcon = QIcon::fromTheme("edit-cut", QIcon(":/images/cut.png"));
     QAction *cutAct = new QAction(cutIcon, tr("Cu&t"), this);
@@ -257,6 +738,99 @@ void MainWindow::createActions()
 
 #endif // !QT_NO_CLIPBOARD
 
+    editMenu->addSeparator();
+    QAction *adjustAct = editMenu->addAction(tr("Adjust &Times..."), this, &MainWindow::adjustTimes);
+    adjustAct->setStatusTip(tr("Add to, subtract from or scale a segment's time in every attempt"));
+
+    QAction *segmentsAct = editMenu->addAction(tr("Edit &Segments..."), this, &MainWindow::editSegments);
+    segmentsAct->setStatusTip(tr("Rename, reorder, insert or delete segments, keeping every attempt's times with its segment"));
+
+    QAction *mergeAct = editMenu->addAction(tr("&Merge Segments..."), this, &MainWindow::mergeSegments);
+    mergeAct->setStatusTip(tr("Combine two adjacent segments into one in every attempt"));
+
+    QAction *splitAct = editMenu->addAction(tr("Sp&lit Segment..."), this, &MainWindow::splitSegment);
+    splitAct->setStatusTip(tr("Divide a segment into two in every attempt"));
+
+    QAction *repairAct = editMenu->addAction(tr("&Repair Runs..."), this, &MainWindow::repairRuns);
+    repairAct->setStatusTip(tr("Find attempts with missing or misplaced splits and fix them"));
+    QAction *cleanUpAct = editMenu->addAction(tr("Clean Up &History..."), this, &MainWindow::cleanUpHistory);
+    cleanUpAct->setStatusTip(tr("Remove segment history entries that don't belong to any attempt or say nothing"));
+
+    QAction *renumberAct = editMenu->addAction(tr("Re&number Attempts..."), this, &MainWindow::renumberAttempts);
+    renumberAct->setStatusTip(tr("Number the attempts 1, 2, 3... in the order they were started"));
+
+    editActs << saveAct << saveAsAct << importAct << adjustAct << segmentsAct << mergeAct << splitAct << repairAct << cleanUpAct << renumberAct;
+
+    QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
+    QActionGroup *timingGroup = new QActionGroup(this);
+    QAction *realTimeAct = viewMenu->addAction(tr("&Real Time"));
+    realTimeAct->setStatusTip(tr("Show and edit times by the wall clock"));
+    gameTimeAct = viewMenu->addAction(tr("&Game Time"));
+    gameTimeAct->setStatusTip(tr("Show and edit times by the game's clock, without loads"));
+    for (QAction *act : {realTimeAct, gameTimeAct}) {
+        act->setCheckable(true);
+        timingGroup->addAction(act);
+    }
+    realTimeAct->setChecked(true);
+    connect(gameTimeAct, &QAction::toggled, this, [this](bool game) {
+        xmlEdit->setTimingMethod(game ? TIMING_GAME : TIMING_REAL);
+    });
+
+    viewMenu->addSeparator();
+    deltaColumnsAct = viewMenu->addAction(tr("&Delta Columns"));
+    deltaColumnsAct->setCheckable(true);
+    deltaColumnsAct->setStatusTip(tr("Show each attempt's times relative to the Personal Best and Best Splits"));
+    connect(deltaColumnsAct, &QAction::toggled, xmlEdit, &XmlEdit::setDeltaColumns);
+
+    QMenu *sortMenu = viewMenu->addMenu(tr("&Sort Attempts"));
+    sortGroup = new QActionGroup(this);
+    const QPair<const char *, RunSortKey> sorts[] = {
+        {QT_TR_NOOP("By &Attempt"), SORT_FILE},
+        {QT_TR_NOOP("By &Final Time"), SORT_FINAL_TIME},
+        {QT_TR_NOOP("By &Start Date"), SORT_STARTED},
+        {QT_TR_NOOP("By Time at S&egment..."), SORT_SEGMENT_TIME},
+        {QT_TR_NOOP("By Segments &Completed"), SORT_SEGMENTS_COMPLETED},
+    };
+    for (const auto &sort : sorts) {
+        QAction *act = sortMenu->addAction(tr(sort.first));
+        act->setCheckable(true);
+        act->setData(int(sort.second));
+        sortGroup->addAction(act);
+        connect(act, &QAction::triggered, this, &MainWindow::sortAttempts);
+    }
+    sortAct = sortGroup->actions().first();
+    sortAct->setChecked(true);
+    sortMenu->addSeparator();
+    sortDescendingAct = sortMenu->addAction(tr("&Descending"));
+    sortDescendingAct->setCheckable(true);
+    sortDescendingAct->setStatusTip(tr("Show the largest first, or for attempts the newest first"));
+    connect(sortDescendingAct, &QAction::toggled, this, &MainWindow::sortAttempts);
+
+    // The chart is only worked out while it's open
+    chartDock = new QDockWidget(tr("Segment Chart"), this);
+    chartDock->setObjectName("chartDock"); // For saveState
+    QWidget *chartPane = new QWidget(chartDock);
+    QVBoxLayout *chartLayout = new QVBoxLayout(chartPane);
+    chartSegmentBox = new QComboBox(chartPane);
+    chart = new SegmentChart(chartPane);
+    chart->setToolTip(tr("Each attempt's time for the segment, oldest on the left, with how often each time came up on the right. Click a point to go to its attempt."));
+    chartLayout->addWidget(chartSegmentBox);
+    chartLayout->addWidget(chart, 1);
+    chartDock->setWidget(chartPane);
+    addDockWidget(Qt::BottomDockWidgetArea, chartDock);
+    chartDock->hide();
+    connect(chartDock, &QDockWidget::visibilityChanged, this, &MainWindow::updateChart);
+    connect(chartSegmentBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::updateChart);
+    connect(chart, &SegmentChart::attemptClicked, xmlEdit, &XmlEdit::showAttempt);
+    QAction *chartAct = chartDock->toggleViewAction();
+    chartAct->setText(tr("Segment C&hart"));
+    chartAct->setStatusTip(tr("Chart one segment's times across every attempt"));
+    viewMenu->addAction(chartAct);
+
+    comparisonMenu = viewMenu->addMenu(tr("&Comparison"));
+    connect(xmlEdit, &XmlEdit::comparisonsChanged, this, &MainWindow::updateComparisonMenu);
+    updateComparisonMenu();
+
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
     QAction *aboutAct = helpMenu->addAction(tr("&About"), this, &MainWindow::about);
     aboutAct->setStatusTip(tr("Show the application's About box"));
@@ -278,6 +852,110 @@ void MainWindow::createActions()
 }
 //! [24]
 
+void MainWindow::setQueryServer(bool on)
+{
+    if (!on) {
+        queryServer->stop();
+        return;
+    }
+    QString errorString;
+    if (!queryServer->start(quint16(queryPort), &errorString)) {
+        QMessageBox::warning(this, tr("XML editor"),
+                             tr("Cannot serve on port %1:\n%2.").arg(queryPort).arg(errorString));
+        queryServerAct->setChecked(false);
+        return;
+    }
+    publishSnapshot();
+    statusBar()->showMessage(tr("Serving to overlays at http://localhost:%1/").arg(queryPort), 5000);
+}
+
+// Switching either way reopens the file: the viewer lets go of the document, and editing needs it back
+void MainWindow::setReadOnly(bool on)
+{
+    if (on == xmlEdit->isReadOnly())
+        return;
+    if (on && !maybeSave()) {
+        const QSignalBlocker blocker(readOnlyAct);
+        readOnlyAct->setChecked(false);
+        return;
+    }
+    xmlEdit->setReadOnly(on);
+    for (QAction *act : editActs)
+        act->setEnabled(!on);
+    if (!curFile.isEmpty())
+        loadFile(curFile);
+}
+
+void MainWindow::publishSnapshot()
+{
+    if (queryServer->isRunning())
+        queryServer->publish(takeQuerySnapshot(*xmlEdit));
+}
+
+// Sorting only moves the attempts' tables around, so it's quick even with thousands of them
+void MainWindow::sortAttempts()
+{
+    QAction *act = sortGroup->checkedAction();
+    RunSortKey key = RunSortKey(act->data().toInt());
+    if (key == SORT_SEGMENT_TIME && sender() == act) { // Picked from the menu, so ask which segment
+        const QStringList &names = xmlEdit->segmentNames();
+        QDialog dialog(this);
+        dialog.setWindowTitle(tr("Sort Attempts"));
+        QFormLayout *form = new QFormLayout(&dialog);
+        QComboBox *segmentBox = new QComboBox(&dialog);
+        segmentBox->addItems(names);
+        segmentBox->setCurrentIndex(qMin(sortSegment, names.size() - 1));
+        form->addRow(tr("Time at:"), segmentBox);
+        QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+        connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+        connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+        form->addRow(buttons);
+        if (names.isEmpty() || dialog.exec() != QDialog::Accepted) {
+            sortAct->setChecked(true);
+            return;
+        }
+        sortSegment = segmentBox->currentIndex();
+    }
+    sortAct = act;
+    xmlEdit->sortAttempts(key, sortSegment, sortDescendingAct->isChecked());
+}
+
+void MainWindow::updateChart()
+{
+    if (!chartDock->isVisible())
+        return;
+    const QStringList &names = xmlEdit->segmentNames();
+    QStringList shown;
+    for (int index = 0; index < chartSegmentBox->count(); index++)
+        shown.append(chartSegmentBox->itemText(index));
+    if (shown != names) {
+        int current = chartSegmentBox->currentIndex();
+        const QSignalBlocker blocker(chartSegmentBox);
+        chartSegmentBox->clear();
+        chartSegmentBox->addItems(names);
+        chartSegmentBox->setCurrentIndex(qBound(0, current, names.size() - 1));
+    }
+    chart->setSegment(*xmlEdit, chartSegmentBox->currentIndex());
+}
+
+// One checkable entry per comparison in the file
+void MainWindow::updateComparisonMenu()
+{
+    comparisonMenu->clear();
+    QActionGroup *group = new QActionGroup(comparisonMenu);
+    const QStringList &names = xmlEdit->comparisonList();
+    for (int index = 0; index < names.size(); index++) {
+        QAction *act = comparisonMenu->addAction(names[index]);
+        act->setCheckable(true);
+        act->setChecked(index == xmlEdit->comparison());
+        group->addAction(act);
+        connect(act, &QAction::triggered, xmlEdit, [this, index]() {
+            xmlEdit->setComparison(index);
+        });
+    }
+    comparisonMenu->setEnabled(!names.isEmpty());
+}
+
 //! [32]
 void MainWindow::createStatusBar()
 //! [32] //! [33]
@@ -300,6 +978,17 @@ void MainWindow::readSettings()
     } else {
         restoreGeometry(geometry);
     }
+    restoreState(settings.value("windowState", QByteArray()).toByteArray()); // Whether the chart is open, and where
+    backupCount = settings.value("backupCount", 3).toInt();
+    autosaveTimer->setInterval(settings.value("autosaveSeconds", 5).toInt() * 1000);
+    xmlEdit->editHistory().setLimit(settings.value("undoMemoryKB", 4096).toLongLong() * 1024);
+    xmlEdit->setLazyTableLimit(settings.value("lazyTables", 0).toInt());
+    liveReloadAct->setChecked(settings.value("liveReload", false).toBool());
+    readOnlyAct->setChecked(settings.value("readOnly", false).toBool());
+    queryPort = settings.value("queryPort", 16835).toInt();
+    queryServerAct->setChecked(settings.value("queryServer", false).toBool());
+    gameTimeAct->setChecked(settings.value("gameTime", false).toBool());
+    deltaColumnsAct->setChecked(settings.value("deltaColumns", false).toBool());
 }
 //! [35] //! [36]
 
@@ -309,6 +998,12 @@ void MainWindow::writeSettings()
 {
     QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
     settings.setValue("geometry", saveGeometry());
+    settings.setValue("windowState", saveState());
+    settings.setValue("liveReload", liveReloadAct->isChecked());
+    settings.setValue("readOnly", readOnlyAct->isChecked());
+    settings.setValue("queryServer", queryServerAct->isChecked());
+    settings.setValue("gameTime", gameTimeAct->isChecked());
+    settings.setValue("deltaColumns", deltaColumnsAct->isChecked());
 }
 //! [38] //! [39]
 
@@ -325,7 +1020,7 @@ bool MainWindow::maybeSave()
                                QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
     switch (ret) {
     case QMessageBox::Save:
-        return save();
+        return save() && finishSave();
     case QMessageBox::Cancel:
         return false;
     default:
@@ -339,24 +1034,48 @@ bool MainWindow::maybeSave()
 void MainWindow::loadFile(const QString &fileName)
 //! [42] //! [43]
 {
-    QFile file(fileName);
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
-        QMessageBox::warning(this, tr("XML editor"),
-                             tr("Cannot read file %1:\n%2.")
-                             .arg(QDir::toNativeSeparators(fileName),
-                                  file.errorString()));
-        return;
-    }
+    finishSave(); // Don't let a save in progress rename the new document when it completes
 
-    if (!xmlEdit->read(&file)) { // Will print own message box
-        setCurrentFile(QString());
+    QString errorString;
+    if (!xmlEdit->readFile(fileName, &errorString)) {
+        if (!errorString.isEmpty()) // Otherwise the parser already explained
+            QMessageBox::warning(this, tr("XML editor"),
+                                 tr("Cannot read file %1:\n%2.")
+                                 .arg(QDir::toNativeSeparators(fileName),
+                                      errorString));
+        else
+            setCurrentFile(QString());
         return;
     }
 
     setCurrentFile(fileName);
+    rememberFileState();
+    if (!xmlEdit->isReadOnly()) // Otherwise left for when it's opened for editing
+        recoverJournal(fileName);
 }
 //! [43]
 
+// If the last session on this file crashed with unsaved edits, offer to replay them
+void MainWindow::recoverJournal(const QString &fileName)
+{
+    QVector<JournalEdit> edits;
+    if (!EditJournal::read(fileName, edits)) { // Missing, or recorded against a different version of the file
+        EditJournal::discard(fileName);
+        return;
+    }
+
+    const QMessageBox::StandardButton ret
+        = QMessageBox::question(this, tr("Application"),
+                                tr("%n unsaved edit(s) to this file were found from a previous session.\n"
+                                   "Do you want to restore them?", "", edits.size()));
+    if (ret == QMessageBox::Yes) {
+        // Replayed edits are recorded again as pending, and will start a fresh journal
+        int applied = xmlEdit->replayJournal(edits);
+        statusBar()->showMessage(tr("Restored %1 of %2 edits").arg(applied).arg(edits.size()), 5000);
+    }
+    EditJournal::discard(fileName);
+}
+
 //! [44]
 bool MainWindow::saveFile(const QString &fileName)
 //! [44] //! [45]
@@ -364,23 +1083,80 @@ bool MainWindow::saveFile(const QString &fileName)
     if (fileName.isEmpty())
         return false;
 
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text)) {
-        QMessageBox::warning(this, tr("XML editor"),
-                             tr("Cannot write file %1:\n%2.")
-                             .arg(QDir::toNativeSeparators(fileName),
-                                  file.errorString()));
-        return false;
+    if (saver) { // One save at a time. Edits made since its snapshot will go in this one
+        queuedSave = fileName;
+        return true;
+    }
+
+    // Make sure every edit the snapshot covers is journaled, in case the save fails
+    if (!curFile.isEmpty())
+        xmlEdit->editJournal().flush(curFile);
+
+    // Serialize and write on a worker, so the UI stays responsive
+    saver = new SnapshotSaver(xmlEdit->snapshot(), fileName, backupCount, isArchivePath(fileName), xmlEdit->generation(), this);
+    savingRecords = xmlEdit->recordsText();
+    SnapshotSaver *started = saver;
+    connect(saver, &SnapshotSaver::progress, this, &MainWindow::saveProgress);
+    connect(saver, &QThread::finished, this, [this, started]() {
+        if (saver == started) // Otherwise finishSave already dealt with it
+            saveFinished();
+    });
+    statusBar()->showMessage(tr("Saving %1...").arg(strippedName(fileName)));
+    saver->start();
+    return true;
+}
+
+void MainWindow::saveProgress(int percent)
+{
+    if (saver)
+        statusBar()->showMessage(tr("Saving %1... %2%").arg(strippedName(saver->target())).arg(percent));
+}
+
+// Block until any save in progress (and any queued behind it) is done. Returns false if the last one failed
+bool MainWindow::finishSave()
+{
+    bool success = true;
+    while (saver) {
+        saver->wait();
+        success = saver->succeeded();
+        saveFinished();
     }
+    return success;
+}
 
-    if (!xmlEdit->write(&file)) {
+void MainWindow::saveFinished()
+{
+    SnapshotSaver *done = saver;
+    saver = NULL;
+    done->deleteLater();
+    xmlEdit->finishSnapshot(done->succeeded(), done->savedBase());
+
+    if (done->succeeded()) {
+        // Journaled edits are in the file now. Any made during the save are still pending
+        EditJournal::discard(done->target());
+        if (!curFile.isEmpty())
+            EditJournal::discard(curFile);
+        xmlEdit->setRecordBaseline(savingRecords); // What's on disk now, whatever was edited since
+        if (xmlEdit->generation() == done->generation()) {
+            xmlEdit->setModified(false);
+            xmlEdit->editJournal().reset(); // Also restarts it, if it had been stopped
+        }
+        setCurrentFile(done->target());
+        rememberFileState();
+        statusBar()->showMessage(tr("Saved %1").arg(strippedName(done->target())), 3000);
+    } else {
+        statusBar()->clearMessage();
         QMessageBox::warning(this, tr("XML editor"),
-                     tr("Cannot read file %1:\nUnknown XML ecoding error.")
-                     .arg(QDir::toNativeSeparators(fileName)));
-        return false;
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(QDir::toNativeSeparators(done->target()),
+                                  done->error()));
     }
 
-    return true;
+    if (!queuedSave.isEmpty()) {
+        QString next = queuedSave;
+        queuedSave.clear();
+        saveFile(next);
+    }
 }
 //! [45]
 
@@ -389,7 +1165,12 @@ void MainWindow::setCurrentFile(const QString &fileName)
 //! [46] //! [47]
 {
     curFile = fileName;
-    setWindowModified(false);
+    setWindowModified(xmlEdit->isModified());
+
+    if (!fileWatcher->files().isEmpty())
+        fileWatcher->removePaths(fileWatcher->files());
+    if (!curFile.isEmpty() && liveReloadAct->isChecked())
+        fileWatcher->addPath(curFile);
 
     QString shownName = curFile;
     if (curFile.isEmpty())
@@ -398,6 +1179,53 @@ void MainWindow::setCurrentFile(const QString &fileName)
 }
 //! [47]
 
+void MainWindow::rememberFileState()
+{
+    QFileInfo info(curFile);
+    knownSize = info.size();
+    knownModified = info.lastModified();
+}
+
+// The file changed on disk, most likely because the timer saved a run. Take in just the new
+// attempts, or if the file changed in some other way, reload it if that loses nothing.
+void MainWindow::liveReload()
+{
+    if (curFile.isEmpty() || !liveReloadAct->isChecked())
+        return;
+    QFileInfo info(curFile);
+    if (!info.exists()) { // Caught between removing the old file and renaming in the new one
+        reloadTimer->start();
+        return;
+    }
+    if (!fileWatcher->files().contains(curFile)) // Replacing the file ends the watch on some systems
+        fileWatcher->addPath(curFile);
+    if (saver || (info.size() == knownSize && info.lastModified() == knownModified))
+        return; // Our own save
+
+    bool structureChanged, recordsKept;
+    QString errorString;
+    int added = xmlEdit->ingestFile(curFile, &structureChanged, &recordsKept, &errorString);
+    if (structureChanged && !xmlEdit->isModified()) {
+        loadFile(curFile);
+        return;
+    }
+    if (added < 0 && !structureChanged) { // Probably read mid-write, the next change will try again
+        statusBar()->showMessage(tr("Could not reload %1: %2").arg(strippedName(curFile), errorString), 5000);
+        return;
+    }
+    rememberFileState();
+    if (structureChanged)
+        statusBar()->showMessage(tr("%1 changed on disk in a way that can't be combined with your edits")
+                                 .arg(strippedName(curFile)), 5000);
+    else if (added > 0 && recordsKept)
+        statusBar()->showMessage(tr("Loaded %n new attempt(s), and kept your unsaved edits to the Personal Best, comparisons or golds over the file's", "", added), 5000);
+    else if (added > 0)
+        statusBar()->showMessage(tr("Loaded %n new attempt(s)", "", added), 3000);
+    else if (recordsKept)
+        statusBar()->showMessage(tr("Kept your unsaved edits to the Personal Best, comparisons or golds over those in %1")
+                                 .arg(strippedName(curFile)), 5000);
+}
+
 //! [48]
 QString MainWindow::strippedName(const QString &fullFileName)
 //! [48] //! [49]
@@ -413,8 +1241,10 @@ void MainWindow::commitData(QSessionManager &manager)
             manager.cancel();
     } else {
         // Non-interactive: save without asking
-        if (xmlEdit->isModified())
+        if (xmlEdit->isModified()) {
             save();
+            finishSave();
+        }
     }
 }
 #endif
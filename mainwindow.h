@@ -52,12 +52,21 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QDateTime>
 #include "xmledit.h"
+#include "saver.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
 class QMenu;
+class QActionGroup;
+class QComboBox;
+class QDockWidget;
 class QSessionManager;
+class QTimer;
+class QFileSystemWatcher;
+class QueryServer;
+class SegmentChart;
 QT_END_NAMESPACE
 
 //! [0]
@@ -69,6 +78,7 @@ public:
     MainWindow();
 
     void loadFile(const QString &fileName);
+    void openRequested(const QString &fileName); // From another launch, see SingleInstance
 
 protected:
     void closeEvent(QCloseEvent *event) override;
@@ -79,8 +89,27 @@ private slots:
     bool save();
     bool saveAs();
     void revert();
+    void exportAttempts();
+    void importAttempts();
+    void syncDatabase();
+    void adjustTimes();
+    void editSegments();
+    void mergeSegments();
+    void splitSegment();
+    void repairRuns();
+    void cleanUpHistory();
+    void renumberAttempts();
     void about();
     void documentWasModified();
+    void autosave();
+    void saveProgress(int percent);
+    void liveReload();
+    void updateComparisonMenu();
+    void sortAttempts();
+    void updateChart();
+    void setQueryServer(bool on);
+    void publishSnapshot();
+    void setReadOnly(bool on);
 #ifndef QT_NO_SESSIONMANAGER
     void commitData(QSessionManager &);
 #endif
@@ -92,11 +121,41 @@ private:
     void writeSettings();
     bool maybeSave();
     bool saveFile(const QString &fileName);
+    bool finishSave();
+    void saveFinished();
+    void recoverJournal(const QString &fileName);
     void setCurrentFile(const QString &fileName);
+    void rememberFileState();
     QString strippedName(const QString &fullFileName);
 
     XmlEdit *xmlEdit;
     QString curFile;
+    QTimer *autosaveTimer;
+    SnapshotSaver *saver; // Save in progress, if any
+    QString queuedSave; // Save requested while another was running
+    QStringList savingRecords; // XmlEdit::recordsText() as the save in progress writes them
+    int backupCount; // Copies of the previous save kept as .bak1, .bak2...
+    QFileSystemWatcher *fileWatcher; // Watches curFile while live reload is on
+    QTimer *reloadTimer; // Waits for the timer to finish rewriting the file
+    QAction *liveReloadAct;
+    QAction *readOnlyAct;
+    QList<QAction *> editActs; // Disabled in viewer mode
+    QAction *gameTimeAct;
+    QAction *deltaColumnsAct;
+    QMenu *comparisonMenu; // Filled from the file's comparisons
+    qint64 knownSize; // curFile as last loaded or saved, so our own saves aren't reloaded
+    QDateTime knownModified;
+    QueryServer *queryServer;
+    QTimer *snapshotTimer; // After a burst of edits, publishes to queryServer and redraws the chart
+    QAction *queryServerAct;
+    int queryPort;
+    QActionGroup *sortGroup;
+    QAction *sortAct; // The sort last applied, to go back to if choosing a segment is cancelled
+    QAction *sortDescendingAct;
+    int sortSegment;
+    QDockWidget *chartDock;
+    QComboBox *chartSegmentBox;
+    SegmentChart *chart;
 };
 //! [0]
 
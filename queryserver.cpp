@@ -0,0 +1,259 @@
+#include "queryserver.h"
+#include "xmledit.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <algorithm>
+
+#define QUERY_REQUEST_LIMIT 8192 // Longest request line and headers read before giving up
+
+QSharedPointer<QuerySnapshot> takeQuerySnapshot(const XmlEdit &edit) {
+	QSharedPointer<QuerySnapshot> snapshot(new QuerySnapshot());
+	const QStringList &names = edit.segmentNames();
+	const SingleRun &pb = edit.personalBest(), &golds = edit.bestSegments();
+	const QHash<qint64, SingleRun> &runs = edit.attemptRuns();
+
+	snapshot->generation = edit.generation();
+	snapshot->game = edit.toplevelText("GameName");
+	snapshot->category = edit.toplevelText("CategoryName");
+	int comparison = edit.comparison();
+	snapshot->comparison = comparison >= 0 && comparison < edit.comparisonList().size() ? edit.comparisonList()[comparison] : QString();
+	snapshot->gameTime = edit.timing() == TIMING_GAME;
+	snapshot->attempts = edit.attemptIds().size();
+	snapshot->pbHas = snapshot->sumOfBestHas = false;
+	snapshot->pbUs = snapshot->sumOfBestUs = 0;
+
+	// Every attempt's split times by segment. Sorting them for the medians is left for the server thread
+	QVector<QVector<quint64>> &history = snapshot->history;
+	history.resize(names.size());
+	for (QVector<quint64> &times : history)
+		times.reserve(runs.size());
+	for (const SingleRun &run : runs) {
+		for (int sidx = 0; sidx < run.splits.size() && sidx < names.size(); sidx++) {
+			const SingleSplit &split = run.splits[sidx];
+			if (split.valid() && split.splitHas)
+				history[sidx].append(split.splitUs);
+		}
+	}
+
+	bool sumValid = true;
+	uint64_t lastTotal = 0;
+	snapshot->segments.resize(names.size());
+	for (int sidx = 0; sidx < names.size(); sidx++) {
+		QuerySegment &segment = snapshot->segments[sidx];
+		segment.name = names[sidx];
+
+		// The PB is kept as totals, and its split times are only worked out on screen
+		const SingleSplit *split = sidx < pb.splits.size() ? &pb.splits[sidx] : NULL;
+		segment.pbHas = split && split->valid() && split->totalHas;
+		segment.pbTotalUs = segment.pbHas ? split->totalUs : 0;
+		segment.pbSplitUs = segment.pbHas ? split->totalUs - lastTotal : 0;
+		if (segment.pbHas)
+			lastTotal = split->totalUs;
+
+		const SingleSplit *gold = sidx < golds.splits.size() ? &golds.splits[sidx] : NULL;
+		segment.goldHas = gold && gold->valid() && gold->splitHas;
+		segment.goldUs = segment.goldHas ? gold->splitUs : 0;
+		sumValid = sumValid && segment.goldHas;
+		snapshot->sumOfBestUs += segment.goldUs;
+	}
+	snapshot->sumOfBestHas = sumValid && !names.isEmpty();
+	if (!snapshot->segments.isEmpty() && snapshot->segments.last().pbHas) {
+		snapshot->pbHas = true;
+		snapshot->pbUs = snapshot->segments.last().pbTotalUs;
+	}
+	return snapshot;
+}
+
+// The per-segment stats, from the copied history, which is let go of after
+static void finishQuerySnapshot(QuerySnapshot &snapshot) {
+	for (int sidx = 0; sidx < snapshot.segments.size() && sidx < snapshot.history.size(); sidx++) {
+		QuerySegment &segment = snapshot.segments[sidx];
+		QVector<quint64> &times = snapshot.history[sidx];
+		segment.count = times.size();
+		segment.bestUs = segment.medianUs = segment.meanUs = 0;
+		if (times.isEmpty())
+			continue;
+		auto middle = times.begin() + times.size() / 2;
+		std::nth_element(times.begin(), middle, times.end());
+		segment.medianUs = *middle;
+		segment.bestUs = *std::min_element(times.begin(), middle + 1);
+		quint64 sum = 0;
+		for (quint64 us : times)
+			sum += us;
+		segment.meanUs = sum / times.size();
+	}
+	snapshot.history.clear();
+	snapshot.history.squeeze();
+}
+
+QueryServer::QueryServer(QObject *parent) : QObject(parent), worker(new QueryWorker(this)), running(false), listeningPort(0) {
+	worker->moveToThread(&thread);
+	connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+	thread.start();
+}
+
+QueryServer::~QueryServer() {
+	stop();
+	thread.quit();
+	thread.wait();
+}
+
+bool QueryServer::start(quint16 port, QString *errorString) {
+	if (running)
+		return true;
+	bool ok = false;
+	QueryWorker *w = worker;
+	quint16 actual = 0;
+	QMetaObject::invokeMethod(worker, [w, port, errorString, &ok, &actual]() {
+		ok = w->listen(port, errorString);
+		actual = w->port();
+	}, Qt::BlockingQueuedConnection);
+	listeningPort = actual;
+	running = ok;
+	return ok;
+}
+
+void QueryServer::stop() {
+	if (!running)
+		return;
+	QueryWorker *w = worker;
+	QMetaObject::invokeMethod(worker, [w]() { w->close(); }, Qt::BlockingQueuedConnection);
+	running = false;
+}
+
+// Queued behind any earlier publish, so the latest one is always the one left current
+void QueryServer::publish(QSharedPointer<QuerySnapshot> snapshot) {
+	QMetaObject::invokeMethod(worker, [this, snapshot]() {
+		finishQuerySnapshot(*snapshot);
+		QSharedPointer<const QuerySnapshot> finished = snapshot;
+		QMutexLocker locker(&mutex);
+		current.swap(finished);
+	}, Qt::QueuedConnection); // The old snapshot is freed after the lock, unless a request still holds it
+}
+
+QSharedPointer<const QuerySnapshot> QueryServer::latest() {
+	QMutexLocker locker(&mutex);
+	return current;
+}
+
+bool QueryWorker::listen(quint16 port, QString *errorString) {
+	if (!server) {
+		server = new QTcpServer(this);
+		connect(server, &QTcpServer::newConnection, this, &QueryWorker::accept);
+	}
+	if (server->listen(QHostAddress::LocalHost, port))
+		return true;
+	*errorString = server->errorString();
+	return false;
+}
+
+void QueryWorker::close() {
+	if (server)
+		server->close();
+}
+
+quint16 QueryWorker::port() const {
+	return server && server->isListening() ? server->serverPort() : 0;
+}
+
+void QueryWorker::accept() {
+	while (QTcpSocket *socket = server->nextPendingConnection()) {
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+			// Only the request line matters, but wait for the end of the headers to answer
+			QByteArray request = socket->peek(QUERY_REQUEST_LIMIT);
+			if (!request.contains("\r\n\r\n") && !request.contains("\n\n") && request.size() < QUERY_REQUEST_LIMIT)
+				return;
+			socket->readAll();
+			disconnect(socket, &QTcpSocket::readyRead, this, nullptr); // One request per connection
+
+			int status = 400;
+			QByteArray body, line = request.left(request.indexOf('\n')).trimmed();
+			QList<QByteArray> parts = line.split(' ');
+			if (parts.size() >= 2 && (parts[0] == "GET" || parts[0] == "HEAD")) {
+				body = respond(parts[1], &status);
+				if (parts[0] == "HEAD")
+					body.clear();
+			} else {
+				body = "{\"error\":\"Only GET is supported\"}\n";
+			}
+			const char *reason = status == 200 ? "OK" : status == 404 ? "Not Found" : status == 503 ? "Service Unavailable" : "Bad Request";
+			QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + "\r\n"
+				"Content-Type: application/json\r\n"
+				"Access-Control-Allow-Origin: *\r\n" // Browser sources in streaming software are another origin
+				"Cache-Control: no-store\r\n"
+				"Connection: close\r\n"
+				"Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+			socket->write(response);
+			socket->disconnectFromHost();
+		});
+	}
+}
+
+static QJsonValue usValue(bool has, quint64 us) {
+	return has ? QJsonValue(double(us)) : QJsonValue(QJsonValue::Null);
+}
+
+// The body for path, from whichever snapshot is current now
+QByteArray QueryWorker::respond(const QByteArray &path, int *status) const {
+	QSharedPointer<const QuerySnapshot> snapshot = owner->latest();
+	if (!snapshot) {
+		*status = 503;
+		return "{\"error\":\"No file is open\"}\n";
+	}
+
+	QByteArray route = path.left(path.indexOf('?'));
+	QJsonObject result;
+	result["generation"] = double(snapshot->generation);
+	result["game"] = snapshot->game;
+	result["category"] = snapshot->category;
+	result["timing"] = snapshot->gameTime ? "GameTime" : "RealTime";
+	QJsonArray segments;
+	*status = 200;
+	if (route == "/splits" || route == "/pb") {
+		for (const QuerySegment &segment : snapshot->segments) {
+			QJsonObject object;
+			object["name"] = segment.name;
+			object["split_us"] = usValue(segment.pbHas, segment.pbSplitUs);
+			object["total_us"] = usValue(segment.pbHas, segment.pbTotalUs);
+			segments.append(object);
+		}
+		result["comparison"] = snapshot->comparison;
+		result["segments"] = segments;
+		if (route == "/pb")
+			result["total_us"] = usValue(snapshot->pbHas, snapshot->pbUs);
+	} else if (route == "/golds") {
+		for (const QuerySegment &segment : snapshot->segments) {
+			QJsonObject object;
+			object["name"] = segment.name;
+			object["gold_us"] = usValue(segment.goldHas, segment.goldUs);
+			segments.append(object);
+		}
+		result["segments"] = segments;
+	} else if (route == "/sum-of-best") {
+		result["sum_of_best_us"] = usValue(snapshot->sumOfBestHas, snapshot->sumOfBestUs);
+		result["pb_us"] = usValue(snapshot->pbHas, snapshot->pbUs);
+	} else if (route == "/stats") {
+		for (const QuerySegment &segment : snapshot->segments) {
+			bool any = segment.count > 0;
+			QJsonObject object;
+			object["name"] = segment.name;
+			object["count"] = segment.count;
+			object["best_us"] = usValue(any, segment.bestUs);
+			object["median_us"] = usValue(any, segment.medianUs);
+			object["mean_us"] = usValue(any, segment.meanUs);
+			object["gold_us"] = usValue(segment.goldHas, segment.goldUs);
+			segments.append(object);
+		}
+		result["attempts"] = snapshot->attempts;
+		result["segments"] = segments;
+	} else {
+		*status = 404;
+		return "{\"error\":\"Try /splits, /golds, /pb, /sum-of-best or /stats\"}\n";
+	}
+	return QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n';
+}
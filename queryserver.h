@@ -0,0 +1,91 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+#include <QString>
+
+class XmlEdit;
+class QTcpServer;
+class QueryServer;
+
+// One segment as the query server reports it. Times are microseconds
+struct QuerySegment {
+    QString name;
+    bool pbHas;
+    quint64 pbSplitUs, pbTotalUs;
+    bool goldHas;
+    quint64 goldUs;
+    int count; // Attempts with a time for this segment; the rest are over them
+    quint64 bestUs, medianUs, meanUs;
+};
+
+// Everything the query server can answer, copied out of the editor in one go. Finished on the
+// server thread and never changed after it's published, so requests can read it while the
+// editor goes on.
+struct QuerySnapshot {
+    quint64 generation; // XmlEdit::generation() it was taken at
+    QString game, category, comparison;
+    bool gameTime;
+    int attempts;
+    QVector<QuerySegment> segments;
+    bool pbHas, sumOfBestHas;
+    quint64 pbUs, sumOfBestUs;
+    QVector<QVector<quint64>> history; // Each segment's split times as copied, until the stats are worked out
+};
+
+// Must be called on the GUI thread, between edits. Only copies the times; sorting them for the
+// stats is left for QueryServer::publish to do on the server thread
+QSharedPointer<QuerySnapshot> takeQuerySnapshot(const XmlEdit &edit);
+
+// Lives on the server thread, and answers requests from whatever snapshot is current then
+class QueryWorker : public QObject {
+	Q_OBJECT
+protected:
+	QueryServer *owner;
+	QTcpServer *server;
+
+	void accept();
+	QByteArray respond(const QByteArray &path, int *status) const;
+
+public:
+	QueryWorker(QueryServer *_owner) : owner(_owner), server(NULL) {}
+
+	// Only on the server thread
+	bool listen(quint16 port, QString *errorString);
+	void close();
+	quint16 port() const;
+};
+
+// Serves the editor's data as JSON over HTTP on localhost, for stream overlays:
+//     /splits /golds /pb /sum-of-best /stats
+// Requests are answered on a thread of their own from the latest published snapshot, so
+// they never wait on the GUI, and a snapshot is only published once an edit is complete.
+class QueryServer : public QObject {
+	Q_OBJECT
+	friend class QueryWorker;
+protected:
+	QThread thread;
+	QueryWorker *worker;
+	QMutex mutex; // Only held to copy or swap current
+	QSharedPointer<const QuerySnapshot> current;
+	bool running;
+	quint16 listeningPort;
+
+	QSharedPointer<const QuerySnapshot> latest();
+
+public:
+	explicit QueryServer(QObject *parent = nullptr);
+	~QueryServer();
+
+	bool start(quint16 port, QString *errorString); // Port 0 picks a free one
+	void stop();
+	bool isRunning() const { return running; }
+	quint16 port() const { return listeningPort; }
+	void publish(QSharedPointer<QuerySnapshot> snapshot); // Finishes it on the server thread, then swaps it in
+};
+
+#endif
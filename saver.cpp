@@ -0,0 +1,219 @@
+#include "saver.h"
+#include "archive.h"
+#include <QSaveFile>
+#include <QFile>
+#include <QXmlStreamReader>
+#include <QHash>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#define SAVE_CHUNK_SIZE ARCHIVE_CHUNK_SIZE // Same size for both formats, so progress works the same
+
+const SavePart *SaveBase::find(quint64 key) const {
+	auto found = std::lower_bound(parts.constBegin(), parts.constEnd(), key, [](const SavePart &part, quint64 key) {
+		return part.key < key;
+	});
+	return found != parts.constEnd() && found->key == key ? found : NULL;
+}
+
+SaveBase SaveBase::index(const QByteArray &bytes) {
+	SaveBase base;
+	base.bytes = bytes;
+	int bom = bytes.startsWith("\xEF\xBB\xBF") ? 3 : 0; // The reader's offsets don't count it
+	QString text = QString::fromUtf8(bytes.constData() + bom, bytes.size() - bom);
+	QByteArray check = text.toUtf8(); // Invalid UTF-8 wouldn't come back the same length
+	if (check.size() != bytes.size() - bom || memcmp(check.constData(), bytes.constData() + bom, check.size()))
+		return base;
+	check.clear();
+
+	// The reader gives offsets in UTF-16 characters, always further on, so they're turned into
+	// bytes by walking forward from the last one
+	const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+	int byteAt = bom, charAt = 0;
+	auto byteOffset = [&](int to) {
+		while (charAt < to) {
+			uchar lead = data[byteAt];
+			int length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+			byteAt += length;
+			charAt += length == 4 ? 2 : 1; // Surrogate pair
+		}
+		return byteAt;
+	};
+
+	QXmlStreamReader reader(text);
+	int depth = 0, segment = -1;
+	bool inSegments = false, inAttempts = false, inSegment = false, inHistory = false;
+	int partDepth = 0, partStart = 0; // partDepth is 0 outside a part
+	quint64 partKey = 0;
+	auto id = [&reader](bool *ok) {
+		return quint32(reader.attributes().value(QLatin1String("id")).toLongLong(ok));
+	};
+	while (!reader.atEnd()) {
+		switch (reader.readNext()) {
+			case QXmlStreamReader::StartDocument:
+				if (!reader.documentEncoding().isEmpty() && reader.documentEncoding().compare(QLatin1String("UTF-8"), Qt::CaseInsensitive))
+					return base; // Patches are UTF-8
+				break;
+			case QXmlStreamReader::StartElement: {
+				depth++;
+				if (partDepth)
+					break;
+				QStringRef name = reader.name();
+				bool ok = true;
+				if (depth == 2) {
+					inSegments = name == QLatin1String("Segments");
+					inAttempts = name == QLatin1String("AttemptHistory");
+					if (!inSegments && !inAttempts)
+						partKey = savePartKey(SAVE_PART_TOPLEVEL, 0, qHash(name.toString()));
+				} else if (depth == 3 && inSegments) {
+					inSegment = name == QLatin1String("Segment");
+					segment += inSegment;
+				} else if (depth == 3 && inAttempts && name == QLatin1String("Attempt")) {
+					partKey = savePartKey(SAVE_PART_ATTEMPT, 0, id(&ok));
+				} else if (depth == 4 && inSegments && inSegment) {
+					inHistory = name == QLatin1String("SegmentHistory");
+					if (!inHistory)
+						partKey = savePartKey(SAVE_PART_SEGMENT, segment, qHash(name.toString()));
+				} else if (depth == 5 && inSegments && inSegment && inHistory && name == QLatin1String("Time")) {
+					partKey = savePartKey(SAVE_PART_TIME, segment, id(&ok));
+				}
+				if (partKey && ok) {
+					partDepth = depth;
+					partStart = byteOffset(text.lastIndexOf('<', int(reader.characterOffset()) - 1));
+				}
+				partKey = ok ? partKey : 0;
+			} break;
+			case QXmlStreamReader::EndElement:
+				if (depth == partDepth) {
+					base.parts.append({partKey, partStart, byteOffset(int(reader.characterOffset()))});
+					partDepth = 0;
+					partKey = 0;
+				}
+				depth--;
+				break;
+			default:
+				break;
+		}
+	}
+	if (reader.hasError())
+		return base;
+
+	std::sort(base.parts.begin(), base.parts.end(), [](const SavePart &a, const SavePart &b) {
+		return a.key < b.key;
+	});
+	for (int idx = 1; idx < base.parts.size(); idx++)
+		if (base.parts[idx - 1].key == base.parts[idx].key) // Can't tell which one an edit was in
+			return base;
+	base.valid = true;
+	return base;
+}
+
+SaveBase SaveBase::patched(const QVector<SavePatch> &patches) const {
+	SaveBase next;
+	qint64 size = bytes.size();
+	QVector<int> shifts; // Bytes gained by the end of each patch, counting the ones before it
+	shifts.reserve(patches.size());
+	for (const SavePatch &patch : patches) {
+		size += patch.bytes.size() - (patch.end - patch.start);
+		shifts.append(int(size - bytes.size()));
+	}
+	if (size >= INT_MAX)
+		return next;
+
+	next.bytes.reserve(int(size));
+	int at = 0;
+	for (const SavePatch &patch : patches) {
+		next.bytes.append(bytes.constData() + at, patch.start - at);
+		next.bytes.append(patch.bytes);
+		at = patch.end;
+	}
+	next.bytes.append(bytes.constData() + at, bytes.size() - at);
+
+	// The parts keep their keys, and move by what the patches before them added
+	next.parts = parts;
+	for (SavePart &part : next.parts) {
+		auto after = std::upper_bound(patches.constBegin(), patches.constEnd(), part.start, [](int start, const SavePatch &patch) {
+			return start < patch.start;
+		});
+		int before = int(after - patches.constBegin());
+		if (before && patches[before - 1].start == part.start) { // Replaced by that patch
+			part.start += before > 1 ? shifts[before - 2] : 0;
+			part.end = part.start + patches[before - 1].bytes.size();
+		} else if (before) {
+			part.start += shifts[before - 1];
+			part.end += shifts[before - 1];
+		}
+	}
+	next.valid = true;
+	return next;
+}
+
+void SnapshotSaver::rotateBackups(const QString &fileName, int backupCount) {
+	if (backupCount <= 0 || !QFile::exists(fileName))
+		return;
+
+	QString prefix = fileName + ".bak";
+	QFile::remove(prefix + QString::number(backupCount));
+	for (int idx = backupCount - 1; idx >= 1; idx--)
+		QFile::rename(prefix + QString::number(idx), prefix + QString::number(idx + 1));
+	QFile::copy(fileName, prefix + "1");
+}
+
+void SnapshotSaver::run() {
+	const int IndentSize = 4;
+
+	// Serializing or patching is roughly the first half of the work, writing the second
+	emit progress(0);
+	QByteArray bytes;
+	if (snapshot.document.isNull()) {
+		saved = snapshot.base.patched(snapshot.patches);
+		if (!saved.valid) {
+			errorString = tr("The file would be too large");
+			return;
+		}
+		bytes = saved.bytes;
+	} else {
+		bytes = snapshot.document.toByteArray(IndentSize);
+		saved.bytes = bytes; // XmlEdit indexes it, so the thread can finish sooner
+	}
+	snapshot = SaveSnapshot(); // Nothing else needs the copy
+	emit progress(50);
+
+	// Write to a temporary file that only replaces the real one once it is complete and synced
+	// Archives are binary, so they must not get newline translation, and neither must a base
+	// read with Windows newlines already in it
+	QSaveFile file(fileName);
+	bool text = !compress && !bytes.contains('\r');
+	if (!file.open(text ? QFile::WriteOnly | QFile::Text : QIODevice::OpenMode(QFile::WriteOnly))) {
+		errorString = file.errorString();
+		return;
+	}
+	bool written = true;
+	if (compress)
+		written = file.write(ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE) == ARCHIVE_MAGIC_SIZE;
+	for (qint64 offset = 0; written && offset < bytes.size(); offset += SAVE_CHUNK_SIZE) {
+		int length = int(qMin<qint64>(SAVE_CHUNK_SIZE, bytes.size() - offset));
+		if (compress) {
+			QByteArray frame = archiveFrame(bytes.constData() + offset, length);
+			written = file.write(frame) == frame.size();
+		} else {
+			written = file.write(bytes.constData() + offset, length) == length;
+		}
+		emit progress(50 + int(50 * (offset + length) / bytes.size()));
+	}
+	if (written && compress)
+		written = file.write(archiveTrailer()) == 4;
+	if (!written) {
+		errorString = file.errorString();
+		file.cancelWriting();
+		return;
+	}
+
+	rotateBackups(fileName, backupCount);
+	if (!file.commit()) {
+		errorString = file.errorString();
+		return;
+	}
+	success = true;
+}
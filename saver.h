@@ -0,0 +1,88 @@
+#ifndef SAVER_H
+#define SAVER_H
+
+#include <QThread>
+#include <QDomDocument>
+#include <QByteArray>
+#include <QVector>
+
+// The parts of a splits file a save can replace on their own: a toplevel element other than
+// Segments and AttemptHistory, a segment's element other than SegmentHistory, one Time in a
+// SegmentHistory, or one Attempt. XmlEdit::touchSaved finds the same parts from the DOM
+enum SavePartKind {
+	SAVE_PART_TOPLEVEL = 1, // By tag
+	SAVE_PART_SEGMENT, // By segment and tag
+	SAVE_PART_TIME, // By segment and id
+	SAVE_PART_ATTEMPT, // By id
+};
+inline quint64 savePartKey(SavePartKind kind, int segment, quint32 low) {
+	return quint64(kind) << 56 | quint64(segment & 0xffffff) << 32 | low;
+}
+
+struct SavePart {
+	quint64 key;
+	int start, end; // Bytes of SaveBase::bytes, end exclusive
+};
+
+// A part as it is now, to go in place of start..end of the base
+struct SavePatch {
+	int start, end;
+	QByteArray bytes;
+};
+
+// The file as last read or saved, with where each part is, so a save only needs to serialize
+// what was edited since
+struct SaveBase {
+	QByteArray bytes; // UTF-8
+	QVector<SavePart> parts; // Sorted by key
+	bool valid = false; // Parts found. Not if the file isn't UTF-8, doesn't parse, or repeats a part
+
+	const SavePart *find(quint64 key) const;
+	static SaveBase index(const QByteArray &bytes); // O(file), so for a worker
+	SaveBase patched(const QVector<SavePatch> &patches) const; // patches sorted by start
+};
+
+// What a save writes: a private copy of the whole document, or the base with patches
+struct SaveSnapshot {
+	QDomDocument document; // Null when patching
+	SaveBase base;
+	QVector<SavePatch> patches;
+};
+
+// Serializes a snapshot and writes it atomically, off the GUI thread. A whole document
+// must not share nodes with the live document, since QDom is not thread safe.
+class SnapshotSaver : public QThread {
+	Q_OBJECT
+protected:
+	SaveSnapshot snapshot;
+	SaveBase saved; // What was written, indexed if it was patched
+	QString fileName;
+	int backupCount;
+	bool compress; // Write a .lssz archive instead of plain XML
+	quint64 snapshotGeneration; // XmlEdit::generation() when the snapshot was taken
+
+	bool success;
+	QString errorString;
+
+	void run() override;
+
+public:
+	SnapshotSaver(const SaveSnapshot &_snapshot, const QString &_fileName, int _backupCount, bool _compress, quint64 _snapshotGeneration, QObject *parent = nullptr)
+		: QThread(parent), snapshot(_snapshot), fileName(_fileName), backupCount(_backupCount), compress(_compress),
+		  snapshotGeneration(_snapshotGeneration), success(false) {}
+
+	// Only meaningful once the thread has finished
+	bool succeeded() const { return success; }
+	QString error() const { return errorString; }
+	QString target() const { return fileName; }
+	quint64 generation() const { return snapshotGeneration; }
+	SaveBase savedBase() const { return saved; } // Not yet indexed after a whole document
+
+	// Shift fileName.bak1..bakN down by one and copy the current file to .bak1
+	static void rotateBackups(const QString &fileName, int backupCount);
+
+Q_SIGNALS:
+	void progress(int percent);
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "segmentchart.h"
+#include "xmledit.h"
+#include <QPainter>
+#include <QMouseEvent>
+#include <algorithm>
+
+#define CHART_BINS 40
+#define CHART_MARGIN 6
+#define CHART_CLICK_SLOP 3 // Pixels either side of a click that still count as hitting a point
+#define CHART_TOP_PERCENTILE 99 // The time axis ends here, so one idle attempt doesn't squash the rest
+
+SegmentChart::SegmentChart(QWidget *parent) : QWidget(parent), attemptCount(0), low(0), high(1), binPeak(0) {
+	setMinimumSize(160, 100);
+	setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void SegmentChart::setSegment(const XmlEdit &edit, int segment) {
+	ids.clear();
+	times.clear();
+	positions.clear();
+	const QVector<qint64> &runKeys = edit.attemptIds();
+	const QHash<qint64, SingleRun> &runs = edit.attemptRuns();
+	attemptCount = runKeys.size();
+	for (int ridx = 0; ridx < runKeys.size(); ridx++) {
+		auto found = runs.constFind(runKeys[ridx]);
+		if (found == runs.constEnd() || segment < 0 || segment >= found->splits.size())
+			continue;
+		const SingleSplit &split = found->splits[segment];
+		if (!split.valid() || !split.splitHas)
+			continue;
+		ids.append(found->id);
+		times.append(split.splitUs);
+		positions.append(ridx);
+	}
+
+	// Time axis, from the fastest time to the percentile
+	bins.fill(0, CHART_BINS);
+	binPeak = 0;
+	if (!times.isEmpty()) {
+		QVector<quint64> sorted = times;
+		auto top = sorted.begin() + (sorted.size() - 1) * CHART_TOP_PERCENTILE / 100;
+		std::nth_element(sorted.begin(), top, sorted.end());
+		high = *top;
+		low = *std::min_element(sorted.begin(), top + 1);
+		if (high <= low)
+			high = low + 1;
+		for (quint64 us : times) {
+			int bin = us >= high ? CHART_BINS - 1 : int((us - low) * CHART_BINS / (high - low));
+			binPeak = qMax(binPeak, ++bins[bin]);
+		}
+	}
+	makeColumns();
+	update();
+}
+
+// Bucket the points by pixel column. Points are in attempt order, so each column is a run of them
+void SegmentChart::makeColumns() {
+	int width = qMax(scatterRect().width(), 1);
+	columns.fill({-1, -1}, width);
+	columnStart.fill(times.size(), width + 1);
+	for (int pidx = times.size() - 1; pidx >= 0; pidx--) {
+		int x = int(qint64(positions[pidx]) * width / qMax(attemptCount, 1));
+		columnStart[x] = pidx;
+		ChartColumn &column = columns[x];
+		if (column.fastest < 0 || times[pidx] < times[column.fastest])
+			column.fastest = pidx;
+		if (column.slowest < 0 || times[pidx] > times[column.slowest])
+			column.slowest = pidx;
+	}
+	for (int x = width - 1; x >= 0; x--) // Empty columns start where the next one does
+		columnStart[x] = qMin(columnStart[x], columnStart[x + 1]);
+}
+
+QRect SegmentChart::scatterRect() const {
+	QRect area = rect().adjusted(CHART_MARGIN, CHART_MARGIN, -CHART_MARGIN, -CHART_MARGIN);
+	area.setWidth(area.width() * 3 / 4);
+	return area;
+}
+
+QRect SegmentChart::histogramRect() const {
+	QRect scatter = scatterRect();
+	return QRect(scatter.right() + CHART_MARGIN, scatter.top(), width() - scatter.right() - 2*CHART_MARGIN, scatter.height());
+}
+
+int SegmentChart::yFor(quint64 us, const QRect &area) const {
+	if (us >= high)
+		return area.top();
+	if (us <= low)
+		return area.bottom();
+	return area.bottom() - int((us - low) * quint64(area.height() - 1) / (high - low));
+}
+
+void SegmentChart::resizeEvent(QResizeEvent *event) {
+	QWidget::resizeEvent(event);
+	makeColumns();
+}
+
+void SegmentChart::paintEvent(QPaintEvent *) {
+	QPainter painter(this);
+	painter.fillRect(rect(), palette().base());
+	if (times.isEmpty()) {
+		painter.setPen(palette().color(QPalette::Disabled, QPalette::Text));
+		painter.drawText(rect(), Qt::AlignCenter, tr("No times for this segment"));
+		return;
+	}
+
+	QRect scatter = scatterRect(), histogram = histogramRect();
+	painter.setPen(palette().color(QPalette::Mid));
+	painter.drawRect(scatter.adjusted(-1, -1, 0, 0));
+
+	// Histogram bars, sideways so they share the scatter's time axis
+	QColor binColor = palette().color(QPalette::Highlight);
+	binColor.setAlpha(128);
+	for (int bin = 0; bin < CHART_BINS; bin++) {
+		if (!bins[bin])
+			continue;
+		int top = yFor(low + (high - low) * (bin + 1) / CHART_BINS, histogram);
+		int bottom = yFor(low + (high - low) * bin / CHART_BINS, histogram);
+		int length = qMax(1, bins[bin] * histogram.width() / binPeak);
+		painter.fillRect(QRect(histogram.left(), top, length, qMax(1, bottom - top)), binColor);
+	}
+
+	// One bar per column. A column with one point is a dot
+	QColor pointColor = palette().color(QPalette::Text);
+	for (int x = 0; x < columns.size(); x++) {
+		const ChartColumn &column = columns[x];
+		if (column.fastest < 0)
+			continue;
+		int top = yFor(times[column.slowest], scatter), bottom = yFor(times[column.fastest], scatter);
+		painter.fillRect(QRect(QPoint(scatter.left() + x - 1, top - 1), QPoint(scatter.left() + x + 1, bottom + 1)), pointColor);
+	}
+
+	painter.setPen(palette().color(QPalette::Text));
+	painter.drawText(scatter.adjusted(CHART_MARGIN, 0, 0, 0), Qt::AlignLeft | Qt::AlignTop, usToStr(high));
+	painter.drawText(scatter.adjusted(CHART_MARGIN, 0, 0, 0), Qt::AlignLeft | Qt::AlignBottom, usToStr(low));
+	painter.drawText(scatter, Qt::AlignRight | Qt::AlignBottom, tr("%n attempt(s)", "", attemptCount));
+}
+
+// The point nearest the click, looking only in the columns within CHART_CLICK_SLOP of it
+void SegmentChart::mousePressEvent(QMouseEvent *event) {
+	QRect scatter = scatterRect();
+	if (event->button() != Qt::LeftButton || times.isEmpty() || !scatter.adjusted(-CHART_CLICK_SLOP, -CHART_CLICK_SLOP, CHART_CLICK_SLOP, CHART_CLICK_SLOP).contains(event->pos())) {
+		QWidget::mousePressEvent(event);
+		return;
+	}
+	int x = event->pos().x() - scatter.left();
+	int first = columnStart[qBound(0, x - CHART_CLICK_SLOP, columns.size())];
+	int last = columnStart[qBound(0, x + CHART_CLICK_SLOP + 1, columns.size())];
+	int best = -1, bestDistance = 0;
+	for (int pidx = first; pidx < last; pidx++) {
+		int column = int(qint64(positions[pidx]) * columns.size() / qMax(attemptCount, 1));
+		int distance = qAbs(column - x) + qAbs(yFor(times[pidx], scatter) - event->pos().y());
+		if (best < 0 || distance < bestDistance) {
+			best = pidx;
+			bestDistance = distance;
+		}
+	}
+	if (best >= 0 && bestDistance <= 4*CHART_CLICK_SLOP)
+		emit attemptClicked(ids[best]);
+}
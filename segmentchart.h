@@ -0,0 +1,52 @@
+#ifndef SEGMENTCHART_H
+#define SEGMENTCHART_H
+
+#include <QWidget>
+#include <QVector>
+
+class XmlEdit;
+
+// One segment's times across every attempt: a scatter of time against attempt number, with a
+// histogram beside it on the same time axis. Everything paint needs is worked out beforehand,
+// and the scatter draws one bar per pixel column from the fastest to the slowest time that
+// lands there, so painting costs the same for a hundred attempts or a hundred thousand.
+class SegmentChart : public QWidget {
+	Q_OBJECT
+protected:
+	// The fastest and slowest points that land in one pixel column of the scatter, or -1
+	struct ChartColumn {
+		int fastest;
+		int slowest;
+	};
+
+	// One point per attempt with a time for the segment, in attempt order
+	QVector<qint64> ids;
+	QVector<quint64> times;
+	QVector<int> positions; // Index into the file's attempts, which is the x axis
+	int attemptCount;
+	quint64 low, high; // Time axis. Times above high are drawn at the top
+	QVector<int> bins;
+	int binPeak;
+	QVector<ChartColumn> columns;
+	QVector<int> columnStart; // columnStart[x] is the first point in column x; one extra at the end
+
+	QRect scatterRect() const;
+	QRect histogramRect() const;
+	int yFor(quint64 us, const QRect &area) const;
+	void makeColumns();
+
+	void paintEvent(QPaintEvent *event) override;
+	void resizeEvent(QResizeEvent *event) override;
+	void mousePressEvent(QMouseEvent *event) override;
+
+public:
+	explicit SegmentChart(QWidget *parent = nullptr);
+
+	void setSegment(const XmlEdit &edit, int segment); // Takes a copy of the times, so call again after edits
+	QSize sizeHint() const override { return QSize(480, 240); }
+
+Q_SIGNALS:
+	void attemptClicked(qint64 id);
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "segmenteditor.h"
+#include <QListWidget>
+#include <QPushButton>
+#include <QLabel>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QDialogButtonBox>
+
+// Each item remembers the index its segment had when the dialog opened, or -1
+#define SOURCE_ROLE Qt::UserRole
+
+static QListWidgetItem *segmentItem(const QString &name, int source) {
+	QListWidgetItem *item = new QListWidgetItem(name);
+	item->setFlags(item->flags() | Qt::ItemIsEditable);
+	item->setData(SOURCE_ROLE, source);
+	return item;
+}
+
+SegmentEditor::SegmentEditor(const QStringList &names, QWidget *parent) : QDialog(parent) {
+	setWindowTitle(tr("Edit Segments"));
+
+	list = new QListWidget(this);
+	for (int idx = 0; idx < names.size(); idx++)
+		list->addItem(segmentItem(names[idx], idx));
+	list->setCurrentRow(0);
+
+	upButton = new QPushButton(tr("Move &Up"), this);
+	downButton = new QPushButton(tr("Move &Down"), this);
+	QPushButton *insertButton = new QPushButton(tr("&Insert"), this);
+	removeButton = new QPushButton(tr("De&lete"), this);
+	connect(upButton, &QPushButton::clicked, this, &SegmentEditor::moveUp);
+	connect(downButton, &QPushButton::clicked, this, &SegmentEditor::moveDown);
+	connect(insertButton, &QPushButton::clicked, this, &SegmentEditor::insert);
+	connect(removeButton, &QPushButton::clicked, this, &SegmentEditor::remove);
+	connect(list, &QListWidget::currentRowChanged, this, &SegmentEditor::updateButtons);
+
+	QVBoxLayout *buttonLayout = new QVBoxLayout;
+	buttonLayout->addWidget(upButton);
+	buttonLayout->addWidget(downButton);
+	buttonLayout->addWidget(insertButton);
+	buttonLayout->addWidget(removeButton);
+	buttonLayout->addStretch();
+
+	QHBoxLayout *hLayout = new QHBoxLayout;
+	hLayout->addWidget(list);
+	hLayout->addLayout(buttonLayout);
+
+	QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+	connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+	connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+	QVBoxLayout *vLayout = new QVBoxLayout(this);
+	vLayout->addWidget(new QLabel(tr("Double-click a segment to rename it. Times recorded for a segment move with it; deleting a segment deletes its times."), this));
+	vLayout->addLayout(hLayout);
+	vLayout->addWidget(buttons);
+
+	updateButtons();
+}
+
+void SegmentEditor::move(int by) {
+	int row = list->currentRow();
+	if (row < 0 || row + by < 0 || row + by >= list->count())
+		return;
+	QListWidgetItem *item = list->takeItem(row);
+	list->insertItem(row + by, item);
+	list->setCurrentRow(row + by);
+}
+
+// New segments go above the current one
+void SegmentEditor::insert() {
+	int row = qMax(list->currentRow(), 0);
+	QListWidgetItem *item = segmentItem(tr("New segment"), -1);
+	list->insertItem(row, item);
+	list->setCurrentRow(row);
+	list->editItem(item);
+}
+
+void SegmentEditor::remove() {
+	if (list->count() > 1)
+		delete list->takeItem(list->currentRow());
+	updateButtons();
+}
+
+void SegmentEditor::updateButtons() {
+	int row = list->currentRow();
+	upButton->setEnabled(row > 0);
+	downButton->setEnabled(row >= 0 && row < list->count() - 1);
+	removeButton->setEnabled(row >= 0 && list->count() > 1);
+}
+
+SegmentLayout SegmentEditor::layout() const {
+	SegmentLayout result;
+	for (int row = 0; row < list->count(); row++) {
+		QListWidgetItem *item = list->item(row);
+		result.source.append(item->data(SOURCE_ROLE).toInt());
+		result.names.append(item->text());
+	}
+	return result;
+}
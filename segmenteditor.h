@@ -0,0 +1,33 @@
+#ifndef SEGMENTEDITOR_H
+#define SEGMENTEDITOR_H
+
+#include <QDialog>
+#include "xmledit.h"
+
+class QListWidget;
+class QPushButton;
+
+// Rename, reorder, insert and delete segments. Nothing touches the document until
+// the dialog is accepted, then layout() goes to XmlEdit::remapSegments.
+class SegmentEditor : public QDialog {
+	Q_OBJECT
+protected:
+	QListWidget *list;
+	QPushButton *upButton, *downButton, *removeButton;
+
+	void move(int by);
+
+protected Q_SLOTS:
+	void moveUp() { move(-1); }
+	void moveDown() { move(1); }
+	void insert();
+	void remove();
+	void updateButtons();
+
+public:
+	SegmentEditor(const QStringList &names, QWidget *parent = nullptr);
+
+	SegmentLayout layout() const;
+};
+
+#endif
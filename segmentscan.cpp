@@ -0,0 +1,133 @@
+#include "segmentscan.h"
+#include "xmledit.h"
+#include <QXmlStreamReader>
+#include <QtConcurrent>
+#include <cstring>
+
+static_assert(TIMING_METHOD_COUNT == 2, "ScannedTime has a slot per TimingMethod");
+
+static bool startsAt(const QByteArray &file, int pos, const char *text) {
+	int length = int(strlen(text));
+	return pos + length <= file.size() && memcmp(file.constData() + pos, text, length) == 0;
+}
+
+static int skipSpace(const QByteArray &file, int pos, int end) {
+	while (pos < end && (file[pos] == ' ' || file[pos] == '\t' || file[pos] == '\r' || file[pos] == '\n'))
+		pos++;
+	return pos;
+}
+
+// The byte scan only knows UTF-8, which is what LiveSplit writes
+static bool isUtf8(const QByteArray &file) {
+	int pos = startsAt(file, 0, "\xEF\xBB\xBF") ? 3 : 0;
+	if (!startsAt(file, pos, "<?xml"))
+		return !startsAt(file, 0, "\xFE\xFF") && !startsAt(file, 0, "\xFF\xFE");
+	int end = file.indexOf("?>", pos);
+	if (end < 0)
+		return false;
+	QByteArray declaration = file.mid(pos, end - pos).toLower();
+	return !declaration.contains("encoding") || declaration.contains("utf-8");
+}
+
+bool splitSegments(const QByteArray &file, QByteArray *skeleton, QVector<ScannedSegment> *segments) {
+	segments->clear();
+	if (!isUtf8(file))
+		return false;
+	int start = file.indexOf("<Segments>");
+	if (start < 0)
+		return false;
+	start += int(strlen("<Segments>"));
+	int end = file.indexOf("</Segments>", start);
+	if (end < 0)
+		return false;
+
+	// Segments don't nest, and anything else here is more than the scan wants to understand
+	for (int pos = skipSpace(file, start, end); pos < end; pos = skipSpace(file, pos, end)) {
+		if (!startsAt(file, pos, "<Segment") || (file[pos + 8] != '>' && file[pos + 8] != ' '))
+			break;
+		int close = file.indexOf("</Segment>", pos);
+		if (close < 0 || close >= end)
+			break;
+		close += int(strlen("</Segment>"));
+		ScannedSegment segment;
+		segment.xml = QByteArray::fromRawData(file.constData() + pos, close - pos);
+		segments->append(segment);
+		pos = close;
+		if (skipSpace(file, pos, end) == end) {
+			if (segments->size() < 2) // Not worth the threads
+				break;
+			*skeleton = file.left(start) + file.mid(end);
+			return true;
+		}
+	}
+	segments->clear();
+	return false;
+}
+
+// The <RealTime> and <GameTime> under the current element
+static void scanTimes(QXmlStreamReader &xml, ScannedTime &time, bool *failed) {
+	time.has[TIMING_REAL] = time.has[TIMING_GAME] = false;
+	while (xml.readNextStartElement()) {
+		TimingMethod method = xml.name() == QLatin1String("GameTime") ? TIMING_GAME : TIMING_REAL;
+		if (method == TIMING_REAL && xml.name() != QLatin1String("RealTime")) {
+			xml.skipCurrentElement();
+			continue;
+		}
+		QString text = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+		if (text.isEmpty()) // Like a DOM element with no text node
+			continue;
+		time.us[method] = strToUs(text, &time.has[method]);
+		if (!time.has[method])
+			*failed = true;
+	}
+}
+
+static void scanSegment(ScannedSegment &segment) {
+	QXmlStreamReader xml(segment.xml);
+	xml.readNextStartElement(); // <Segment>
+	while (xml.readNextStartElement()) {
+		if (xml.name() == QLatin1String("Name")) {
+			segment.name = xml.readElementText(QXmlStreamReader::IncludeChildElements);
+			segment.hasName = !segment.name.isEmpty();
+		} else if (xml.name() == QLatin1String("SplitTimes")) {
+			while (xml.readNextStartElement()) {
+				if (xml.name() != QLatin1String("SplitTime")) {
+					xml.skipCurrentElement();
+					continue;
+				}
+				segment.comparisonNames.append(xml.attributes().value(QLatin1String("name")).toString());
+				segment.comparisons.append(ScannedTime());
+				scanTimes(xml, segment.comparisons.last(), &segment.failed);
+			}
+		} else if (xml.name() == QLatin1String("BestSegmentTime")) {
+			segment.hasBest = true;
+			scanTimes(xml, segment.best, &segment.failed);
+		} else if (xml.name() == QLatin1String("SegmentHistory")) {
+			while (xml.readNextStartElement()) {
+				if (xml.name() != QLatin1String("Time")) {
+					xml.skipCurrentElement();
+					continue;
+				}
+				ScannedTime time;
+				bool success;
+				time.id = xml.attributes().value(QLatin1String("id")).toLongLong(&success);
+				if (!success)
+					segment.failed = true;
+				scanTimes(xml, time, &segment.failed);
+				segment.history.append(time);
+			}
+		} else {
+			xml.skipCurrentElement();
+		}
+	}
+	if (xml.hasError())
+		segment.failed = true;
+}
+
+bool scanSegments(QVector<ScannedSegment> &segments) {
+	QtConcurrent::blockingMap(segments, scanSegment);
+	for (const ScannedSegment &segment : segments)
+		if (segment.failed)
+			return false;
+	return true;
+}
@@ -0,0 +1,39 @@
+#ifndef SEGMENTSCAN_H
+#define SEGMENTSCAN_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// One <Time>, <SplitTime> or <BestSegmentTime>: the times under it, indexed by TimingMethod
+struct ScannedTime {
+    qint64 id; // <Time id>; unused otherwise
+    bool has[2];
+    uint64_t us[2];
+};
+
+// Everything the parser wants from one <Segment>, in file order
+struct ScannedSegment {
+    QByteArray xml; // Points into the file's bytes, which must outlive the scan
+    bool hasName = false;
+    QString name;
+    bool hasBest = false;
+    ScannedTime best;
+    QStringList comparisonNames;
+    QVector<ScannedTime> comparisons; // Parallel to comparisonNames
+    QVector<ScannedTime> history;
+    bool failed = false;
+};
+
+// Find the <Segment> elements of a whole file with a byte scan. skeleton gets the file with
+// the inside of <Segments> cut out, for the DOM parser. Returns false for anything the scan
+// doesn't handle (not UTF-8, fewer than two segments, something between segments), in which
+// case the file should be parsed the usual way.
+bool splitSegments(const QByteArray &file, QByteArray *skeleton, QVector<ScannedSegment> *segments);
+
+// Parse each segment on a thread of its own. Returns false if any of them failed, in which
+// case the usual parser will find the problem and say what it is.
+bool scanSegments(QVector<ScannedSegment> &segments);
+
+#endif
@@ -0,0 +1,69 @@
+#include "singleinstance.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QDir>
+
+#define FORWARD_TIMEOUT_MS 500
+
+// Per user, since another user's instance can't open our files
+static QString serverName() {
+	return QString("%1-%2").arg(QCoreApplication::applicationName()).arg(qHash(QDir::homePath()), 0, 16);
+}
+
+SingleInstance::SingleInstance(QObject *parent) : QObject(parent), server(new QLocalServer(this)) {
+	connect(server, &QLocalServer::newConnection, this, &SingleInstance::accept);
+}
+
+// The message is the file's absolute path as one line of UTF-8
+bool SingleInstance::forward(const QString &fileName) {
+	QLocalSocket socket;
+	socket.connectToServer(serverName());
+	if (!socket.waitForConnected(FORWARD_TIMEOUT_MS))
+		return false; // Nobody there, or a socket left by a crash
+	QString path = fileName.isEmpty() ? QString() : QFileInfo(fileName).absoluteFilePath();
+	socket.write(path.toUtf8() + '\n');
+	if (!socket.waitForBytesWritten(FORWARD_TIMEOUT_MS))
+		return false;
+	socket.disconnectFromServer();
+	if (socket.state() != QLocalSocket::UnconnectedState)
+		socket.waitForDisconnected(FORWARD_TIMEOUT_MS);
+	return true;
+}
+
+bool SingleInstance::listen() {
+	if (server->listen(serverName()))
+		return true;
+	if (server->serverError() != QAbstractSocket::AddressInUseError)
+		return false;
+	// A crashed instance's socket file, or a launch racing this one that started listening after
+	// forward() looked. Only remove it if nobody answers, or the other one would never hear again
+	QLocalSocket probe;
+	probe.connectToServer(serverName());
+	if (probe.waitForConnected(FORWARD_TIMEOUT_MS)) {
+		probe.disconnectFromServer();
+		return false;
+	}
+	if (!QLocalServer::removeServer(serverName()))
+		return false;
+	return server->listen(serverName());
+}
+
+void SingleInstance::accept() {
+	while (QLocalSocket *socket = server->nextPendingConnection()) {
+		auto read = [this, socket]() {
+			while (socket->canReadLine()) {
+				QString path = QString::fromUtf8(socket->readLine());
+				path.chop(1);
+				emit openRequested(path);
+			}
+		};
+		connect(socket, &QLocalSocket::readyRead, this, read);
+		connect(socket, &QLocalSocket::disconnected, this, [socket, read]() {
+			read(); // The whole message may arrive together with the hangup
+			socket->deleteLater();
+		});
+		read();
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QString>
+
+class QLocalServer;
+
+// Lets a second launch hand its file to the SplitEdit already running, over a local socket
+// named for this user, instead of starting up a whole second window.
+class SingleInstance : public QObject {
+	Q_OBJECT
+protected:
+	QLocalServer *server;
+
+	void accept();
+
+public:
+	explicit SingleInstance(QObject *parent = nullptr);
+
+	// If another instance is listening, send it fileName (empty to just bring it forward) and
+	// return true once it has the message. Takes a few milliseconds either way.
+	static bool forward(const QString &fileName);
+	// Start listening. Returns false if another instance beat us to it, so try forward() again
+	bool listen();
+
+Q_SIGNALS:
+	void openRequested(const QString &fileName); // Empty if no file was given
+};
+
+#endif
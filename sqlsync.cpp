@@ -0,0 +1,157 @@
+#include "sqlsync.h"
+#include "xmledit.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+
+#define SYNC_CONNECTION "SplitEditSync"
+
+static const char *schema[] = {
+	"CREATE TABLE IF NOT EXISTS attempts ("
+		"id INTEGER PRIMARY KEY, started TEXT, total_us INTEGER)",
+	"CREATE TABLE IF NOT EXISTS segments ("
+		"segment_index INTEGER PRIMARY KEY, name TEXT)",
+	"CREATE TABLE IF NOT EXISTS segment_times ("
+		"attempt_id INTEGER NOT NULL REFERENCES attempts(id), segment_index INTEGER NOT NULL, "
+		"split_us INTEGER, total_us INTEGER, skipped INTEGER NOT NULL, "
+		"PRIMARY KEY (attempt_id, segment_index)) WITHOUT ROWID",
+	"CREATE INDEX IF NOT EXISTS segment_times_by_segment ON segment_times(segment_index, split_us)",
+	"CREATE INDEX IF NOT EXISTS attempts_by_total ON attempts(total_us)",
+	"CREATE TABLE IF NOT EXISTS meta ("
+		"key TEXT PRIMARY KEY, value TEXT)",
+};
+
+// Report error, abandon the transaction if one is open, and return the failure value
+static qint64 fail(const QSqlError &error, QString *errorString, QSqlDatabase *rollback = nullptr) {
+	*errorString = error.text();
+	if (rollback)
+		rollback->rollback();
+	return -1;
+}
+
+// Fills in databases opened by syncToDatabase. Returns -1 on failure
+static qint64 syncOpenDatabase(const XmlEdit &edit, QSqlDatabase &db, QString *errorString) {
+	QSqlQuery query(db);
+	for (const char *statement : schema)
+		if (!query.exec(statement))
+			return fail(query.lastError(), errorString);
+
+	// High-water mark: attempt ids only ever grow, so anything at or below this is already stored
+	if (!query.exec("SELECT MAX(id) FROM attempts") || !query.next())
+		return fail(query.lastError(), errorString);
+	bool haveHighWater = !query.value(0).isNull();
+	qint64 highWater = query.value(0).toLongLong();
+
+	if (!db.transaction())
+		return fail(db.lastError(), errorString);
+
+	// Stored segment_index values are only right for the segments they were synced under. After
+	// segments are reordered, merged or split, or the timing method changes, every stored time is
+	// synced again rather than left attached to the wrong segment
+	QString layout = QString(edit.timing() == TIMING_GAME ? "GameTime" : "RealTime") + '\n' + edit.segmentNames().join('\n');
+	if (!query.exec("SELECT value FROM meta WHERE key = 'segment_layout'"))
+		return fail(query.lastError(), errorString, &db);
+	bool resync = haveHighWater && (!query.next() || query.value(0).toString() != layout);
+	query.finish();
+	if (!query.prepare("INSERT OR REPLACE INTO meta (key, value) VALUES ('segment_layout', ?)"))
+		return fail(query.lastError(), errorString, &db);
+	query.bindValue(0, layout);
+	if (!query.exec())
+		return fail(query.lastError(), errorString, &db);
+
+	QSqlQuery segmentQuery(db), attemptQuery(db), timeQuery(db);
+	if (!segmentQuery.prepare("INSERT OR REPLACE INTO segments (segment_index, name) VALUES (?, ?)")
+		|| !attemptQuery.prepare("INSERT INTO attempts (id, started, total_us) VALUES (?, ?, ?)")
+		|| !timeQuery.prepare("INSERT INTO segment_times (attempt_id, segment_index, split_us, total_us, skipped) VALUES (?, ?, ?, ?, ?)"))
+		return fail(segmentQuery.lastError().isValid() ? segmentQuery.lastError() :
+			attemptQuery.lastError().isValid() ? attemptQuery.lastError() : timeQuery.lastError(), errorString, &db);
+
+	// Segment names are few and may have been renamed, so always refresh them, and drop any past the last
+	const QStringList &splitNames = edit.segmentNames();
+	for (int sidx = 0; sidx < splitNames.size(); sidx++) {
+		segmentQuery.bindValue(0, sidx);
+		segmentQuery.bindValue(1, splitNames[sidx]);
+		if (!segmentQuery.exec())
+			return fail(segmentQuery.lastError(), errorString, &db);
+	}
+	if (!query.prepare("DELETE FROM segments WHERE segment_index >= ?"))
+		return fail(query.lastError(), errorString, &db);
+	query.bindValue(0, splitNames.size());
+	if (!query.exec())
+		return fail(query.lastError(), errorString, &db);
+
+	// The high-water mark only holds while ids keep meaning the same attempts. After compactIds, or
+	// if the newest attempts were deleted and their ids reused, a stored id is started at a
+	// different time in the file, so the stored attempts are dropped and all of them synced again
+	const QHash<qint64, SingleRun> &runs = edit.attemptRuns();
+	if (haveHighWater && !resync) {
+		if (!query.exec("SELECT id, started FROM attempts"))
+			return fail(query.lastError(), errorString, &db);
+		while (!resync && query.next()) {
+			auto found = runs.constFind(query.value(0).toLongLong());
+			resync = found != runs.constEnd() && found.value().timeLabel != query.value(1).toString();
+		}
+	}
+	if (resync) {
+		if (!query.exec("DELETE FROM segment_times") || !query.exec("DELETE FROM attempts"))
+			return fail(query.lastError(), errorString, &db);
+		haveHighWater = false;
+	}
+
+	const QVariant null(QVariant::LongLong);
+	qint64 added = 0;
+	for (qint64 id : edit.attemptIds()) {
+		if (haveHighWater && id <= highWater)
+			continue;
+		auto found = runs.constFind(id);
+		if (found == runs.constEnd())
+			continue;
+		const SingleRun &run = found.value();
+
+		bool totalSuccess = false;
+		uint64_t runTotal = run.realTimeTotal.isNull() ? 0 : strToUs(run.realTimeTotal.data(), &totalSuccess);
+		if (edit.isReleased() && run.splits.size() == splitNames.size() && !run.splits.isEmpty() && run.splits.last().totalHas) {
+			runTotal = run.splits.last().totalUs; // Viewer mode keeps no DOM, but the final time is the last total
+			totalSuccess = true;
+		}
+		attemptQuery.bindValue(0, id);
+		attemptQuery.bindValue(1, run.timeLabel);
+		attemptQuery.bindValue(2, totalSuccess ? QVariant(qint64(runTotal)) : null);
+		if (!attemptQuery.exec())
+			return fail(attemptQuery.lastError(), errorString, &db);
+
+		RunningTotal total;
+		for (int sidx = 0; sidx < run.splits.size(); sidx++) {
+			const SingleSplit &split = run.splits[sidx];
+			bool totalHas = total.add(split);
+			timeQuery.bindValue(0, id);
+			timeQuery.bindValue(1, sidx);
+			timeQuery.bindValue(2, split.splitHas ? QVariant(qint64(split.splitUs)) : null);
+			timeQuery.bindValue(3, totalHas ? QVariant(qint64(total.us)) : null);
+			timeQuery.bindValue(4, split.splitHas ? 0 : 1);
+			if (!timeQuery.exec())
+				return fail(timeQuery.lastError(), errorString, &db);
+		}
+		added++;
+	}
+
+	if (!db.commit())
+		return fail(db.lastError(), errorString, &db);
+	return added;
+}
+
+qint64 syncToDatabase(const XmlEdit &edit, const QString &databasePath, QString *errorString) {
+	qint64 result = -1;
+	{ // The QSqlDatabase handle must be gone before the connection is removed
+		QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", SYNC_CONNECTION);
+		db.setDatabaseName(databasePath);
+		if (db.open())
+			result = syncOpenDatabase(edit, db, errorString);
+		else
+			*errorString = db.lastError().text();
+		db.close();
+	}
+	QSqlDatabase::removeDatabase(SYNC_CONNECTION);
+	return result;
+}
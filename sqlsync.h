@@ -0,0 +1,21 @@
+#ifndef SQLSYNC_H
+#define SQLSYNC_H
+
+#include <QString>
+
+class XmlEdit;
+
+// Copy parsed attempts into a SQLite database with tables
+//     attempts(id, started, total_us)
+//     segments(segment_index, name)
+//     segment_times(attempt_id, segment_index, split_us, total_us, skipped)
+//     meta(key, value)
+// Only attempts with ids above the highest one already stored are inserted, in one transaction.
+// If the segments or timing method differ from those stored in meta at the last sync, every
+// attempt is inserted again so no time stays attached to a segment it no longer belongs to.
+// If a stored id has a different start time in the file, as after renumbering, the stored
+// attempts are replaced and every attempt is inserted again.
+// Returns the number of attempts added, or -1 with errorString set.
+qint64 syncToDatabase(const XmlEdit &edit, const QString &databasePath, QString *errorString);
+
+#endif
@@ -1,52 +1,75 @@
 #include "xmledit.h"
 #include <QMessageBox>
 #include <QTextStream>
-#include <QStack>
+#include <QFile>
+#include <QTimer>
+#include <QClipboard>
 #include <QLineEdit>
 #include <QPlainTextEdit>
 #include <QHeaderView>
 #include <QScrollBar>
 #include <QApplication>
+#include <QDateTime>
+#include <QBuffer>
+#include <QSet>
+#include <QVarLengthArray>
+#include <QtConcurrent>
+#include <climits>
+#include <cmath>
+#include <algorithm>
 #include "TableWidgetNoScroll.h"
+#include "archive.h"
+#include "importer.h"
+#include "segmentscan.h"
 
 #define REALTIME_TOTAL_STR(x) (QString(tr("Total time: %1")).arg(x))
 #define SUPPRESS_DEBUG_FNS
 
+// Accepts [[hh:]mm:]ss[.ffffff]; fraction digits past microseconds are ignored.
+// Scans the characters in place, because this runs once per <RealTime> on load.
 uint64_t strToUs(const QString &s, bool *success) {
 	*success = false;
-	uint64_t result = 0;
-	bool tempSuccess;
-
-	QStringList csegs = s.split(":");
-	QStringList decimal = csegs.constLast().split(".");
-
-	if (decimal.size() > 2) return 0; // FAIL seconds.miliseconds is not a decimal
-
-	result = decimal[0].toLongLong(&tempSuccess) * 1000*1000; // Seconds
-	if (!tempSuccess) return 0; // FAIL invalid seconds
-	if (decimal.size() == 2) { // Allow both :0 and :0.03
-		QString s = decimal[1];
-		s.toLongLong(&tempSuccess); // Test valid int before divide
-		if (!s.isEmpty() && !tempSuccess) return 0; // FAIL nonempty but invalid us
-		s.truncate(6);
-		while (s.size() < 6)
-			s = s + "0";
-		result += s.toLongLong(&tempSuccess); // Milliseconds
+	const QChar *c = s.constData();
+	const QChar *end = c + s.size();
+	while (c < end && c->isSpace())
+		c++;
+	while (end > c && (end-1)->isSpace())
+		end--;
+
+	uint64_t result = 0; // Seconds, until the fraction
+	int colons = 0;
+	while (1) {
+		uint64_t field = 0;
+		int digits = 0;
+		while (c < end && c->unicode() >= '0' && c->unicode() <= '9') {
+			field = field*10 + (c->unicode() - '0');
+			digits++;
+			c++;
+		}
+		if (!digits || digits > 12) return 0; // FAIL empty or absurd field
+		result += field;
+		if (c < end && *c == QLatin1Char(':')) {
+			if (++colons > 2) return 0; // FAIL too many colons
+			result *= 60;
+			c++;
+		} else {
+			break;
+		}
 	}
-
-	csegs = csegs.mid(0, csegs.size()-1);
-	if (csegs.size() > 0) {
-		result += csegs.constLast().toLongLong(&tempSuccess)*60*1000*1000; // Minutes
-		if (!tempSuccess) return 0; // FAIL invalid minutes
-
-		csegs = csegs.mid(0, csegs.size()-1);
-		if (csegs.size() > 0) {
-			result += csegs.constLast().toLongLong(&tempSuccess)*60*60*1000*1000; // Hours
-			if (!tempSuccess) return 0;  // FAIL invalid hours
-			if (csegs.size() > 1) return 0; // FAIL too many colons
+	result *= 1000*1000;
+
+	if (c < end && *c == QLatin1Char('.')) { // Allow both :0 and :0.03
+		c++;
+		uint64_t scale = 100*1000;
+		while (c < end && c->unicode() >= '0' && c->unicode() <= '9') {
+			result += (c->unicode() - '0') * scale;
+			scale /= 10;
+			c++;
 		}
 	}
 
+	if (c != end) return 0; // FAIL garbage after the number
+
 	*success = true;
 	return result;
 }
@@ -87,16 +110,20 @@ static void testStrToUs(QString str) {
 }
 #endif
 
+static QString timingTag(TimingMethod method) {
+	return method == TIMING_GAME ? QStringLiteral("GameTime") : QStringLiteral("RealTime");
+}
+
 // Call textXml.setData, but create DOM nodes along the path if needed
 // QDomDocument object is needed to create new nodes, so we have to pass it in :/
-static void writeXml(QDomDocument domDocument, uint64_t us, bool present, QDomElement outerXml, QDomElement &realTimeXml, QDomCharacterData &textXml) {
+static void writeXml(QDomDocument domDocument, uint64_t us, bool present, QDomElement outerXml, QDomElement &realTimeXml, QDomCharacterData &textXml, TimingMethod method = TIMING_REAL) {
 	if (outerXml.isNull()) {
 		fprintf(stderr, "Warning: Tried to modify DOM for time, but containing XML was null. This file seems to be malformed. Aborting modification\n");
 		return;
 	}
 	if (present) {
 		if (realTimeXml.isNull()) {
-			realTimeXml = outerXml.insertAfter(domDocument.createElement("RealTime"), QDomNode()).toElement();
+			realTimeXml = outerXml.insertAfter(domDocument.createElement(timingTag(method)), QDomNode()).toElement();
 			textXml.clear();
 		}
 		if (textXml.isNull()) {
@@ -107,7 +134,7 @@ static void writeXml(QDomDocument domDocument, uint64_t us, bool present, QDomEl
 		if (!realTimeXml.isNull()) {
 			if (!outerXml.isNull())
 				outerXml.removeChild(realTimeXml);
-			outerXml.clear();
+			realTimeXml.clear();
 		}
 		textXml.clear();
 	}
@@ -115,7 +142,71 @@ static void writeXml(QDomDocument domDocument, uint64_t us, bool present, QDomEl
 
 // Call writeXml for a single split
 void SingleSplit::write(QDomDocument domDocument) {
-	writeXml(domDocument, xmlIsTotal ? totalUs : splitUs, xmlIsTotal ? totalHas : splitHas, timeXml, realTimeXml, textXml);
+	writeXml(domDocument, xmlIsTotal ? totalUs : splitUs, xmlIsTotal ? totalHas : splitHas, timeXml, realTimeXml, textXml, method);
+}
+
+void SingleSplit::swapTimingMethod() {
+	std::swap(xmlIsTotal ? totalHas : splitHas, otherHas);
+	std::swap(xmlIsTotal ? totalUs : splitUs, otherUs);
+	std::swap(realTimeXml, otherXml);
+	std::swap(textXml, otherTextXml);
+	method = method == TIMING_GAME ? TIMING_REAL : TIMING_GAME;
+}
+
+// Put the timing method that isn't shown in the fields for the shown one, or back again.
+// Whatever isn't in the XML (totals for a run, splits for a comparison) is left stale.
+static void swapRunTimingMethod(SingleRun &run) {
+	for (SingleSplit &split : run.splits)
+		split.swapTimingMethod();
+	std::swap(run.realTimeTotal, run.otherTotal);
+}
+
+// Work out a run's split times from its totals, as correctTable does for the Personal Best
+static void splitsFromTotals(SingleRun &run) {
+	uint64_t lastUs = 0;
+	for (SingleSplit &split : run.splits) {
+		split.splitHas = split.totalHas;
+		if (split.totalHas) {
+			split.splitUs = split.totalUs - lastUs;
+			lastUs = split.totalUs;
+		}
+	}
+}
+
+// The other way around, as correctTable does for runs
+static void totalsFromSplits(SingleRun &run) {
+	RunningTotal total;
+	for (SingleSplit &split : run.splits) {
+		split.totalHas = total.add(split);
+		split.totalUs = total.us;
+	}
+}
+
+// Exchange two comparison columns' times and DOM handles, leaving each table cell where it is
+static void swapComparison(SingleRun &shown, SingleRun &stored) {
+	for (int sidx = 0; sidx < shown.splits.size() && sidx < stored.splits.size(); sidx++) {
+		SingleSplit &split = shown.splits[sidx];
+		QTableWidgetItem *splitTimeWidget = split.splitTimeWidget, *totalTimeWidget = split.totalTimeWidget;
+		std::swap(split, stored.splits[sidx]);
+		split.splitTimeWidget = splitTimeWidget;
+		split.totalTimeWidget = totalTimeWidget;
+		stored.splits[sidx].splitTimeWidget = stored.splits[sidx].totalTimeWidget = NULL;
+	}
+}
+
+// Label for the table of the comparison shown
+static QString comparisonTitle(const QString &name) {
+	if (name == QLatin1String("Personal Best"))
+		return XmlEdit::tr("Personal Best");
+	return XmlEdit::tr("Comparison: %1").arg(name);
+}
+
+// The <Segment> elements, in the order the parser numbers them
+static QVector<QDomElement> segmentElements(const QDomElement &segmentsXml) {
+	QVector<QDomElement> segments;
+	for (QDomElement segment = segmentsXml.firstChildElement("Segment"); !segment.isNull(); segment = segment.nextSiblingElement("Segment"))
+		segments.append(segment);
+	return segments;
 }
 
 DocumentEdit::DocumentEdit(QWidget *parent) : QScrollArea(parent) {
@@ -126,15 +217,21 @@ void DocumentEdit::clearUi() {
 	setWidget(new QWidget());
 }
 
-XmlEdit::XmlEdit(QWidget *parent) : DocumentEdit(parent), vLayout(NULL), stopIcon(QApplication::style()->standardIcon(QStyle::SP_BrowserStop)), monoFont("generic-mono-font-pqfugjdf") {
-	standaloneKeys["GameName"] = tr("Game name:");
-	standaloneKeys["CategoryName"] = tr("Category name:");
-	standaloneKeys["AttemptCount"] = tr("Attempts");
-	standaloneKeys["Offset"] = tr("Offset:");
+XmlEdit::XmlEdit(QWidget *parent) : DocumentEdit(parent), vLayout(NULL), attemptLayout(NULL), correctingTable(false), modified(false), editGeneration(0), indexingSaveBase(false), saveWhole(false), saveInFlightWhole(false), renderEnabled(true), readOnly(false), released(false), deltaColumns(false), visibleUpdatePending(false), deltaEpoch(1), lazyTableLimit(0), visiblePass(0), sortKey(SORT_FILE), sortSegment(0), sortDescending(false), timingMethod(TIMING_REAL), shownComparisonName("Personal Best"), tableRowHeight(0), stopIcon(QApplication::style()->standardIcon(QStyle::SP_BrowserStop)), monoFont("generic-mono-font-pqfugjdf") {
+	standaloneLabels[TAG_GAME_NAME] = tr("Game name:");
+	standaloneLabels[TAG_CATEGORY_NAME] = tr("Category name:");
+	standaloneLabels[TAG_ATTEMPT_COUNT] = tr("Attempts");
+	standaloneLabels[TAG_OFFSET] = tr("Offset:");
 
 	runTableLabels += QString(tr("Split name", "Table header split name"));
 	runTableLabels += QString(tr("Split", "Table header split time"));
 	runTableLabels += QString(tr("Total", "Table header total time"));
+	runTableLabels += QString(tr("Δ PB", "Table header total time minus PB total"));
+	runTableLabels += QString(tr("Δ Gold", "Table header split time minus best split"));
+
+	// The delta cells on screen can change with any of these
+	connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &XmlEdit::scheduleVisibleUpdate);
+	connect(verticalScrollBar(), &QScrollBar::rangeChanged, this, &XmlEdit::scheduleVisibleUpdate);
 
 	// monoFont is intentionally assigned a nonsense name so that setStyleHint picks the font by itself
 	monoFont.setStyleHint(QFont::Monospace);
@@ -151,14 +248,24 @@ void XmlEdit::clearUi() {
 
 	topSegment = -1; // This is all essentially UI state
 	bestSplits = SingleRun();
+	bestSplits.id = RUN_ID_BEST_SPLITS;
 	bestRun = SingleRun();
+	bestRun.id = RUN_ID_PERSONAL_BEST;
 	runKeys.clear();
+	runOrder.clear();
 	runs.clear();
+	runsById.clear();
+	builtIds.clear();
 	splitNames.clear();
+	comparisonNames.clear();
+	comparisons.clear();
+	shownComparison = -1;
+	standaloneEdits.clear();
 	columnWidthHave = false;
 
 	vLayout = new QVBoxLayout(widget());
 	widget()->setLayout(vLayout);
+	attemptLayout = NULL; // Made once the Best Splits are laid out
 }
 
 // Unused, artifact of old XmlEdit program
@@ -192,30 +299,37 @@ static const QString &nodeTypeName(QDomNode::NodeType nodeType) {
 #include <watchers.h>
 
 void XmlEdit::addNodeFail(ParseState &state, QString message) {
-	QMessageBox messageBox(this);
-	messageBox.setText(QString(tr("Could not open this file: %1").arg(message)));
-	messageBox.exec();
+	if (renderEnabled) {
+		QMessageBox messageBox(this);
+		messageBox.setText(QString(tr("Could not open this file: %1").arg(message)));
+		messageBox.exec();
+	} else {
+		readError = message;
+	}
 	state.dead = true;
 }
 
-QString fetchElement(QDomElement element, QString name) {
-	QDomAttr attr = element.attributes().namedItem(name).toAttr();
-	if (attr.isNull())
-		return QString();
+// Without tables there's no one to show a box to (the command line), so readFile() returns it
+void XmlEdit::readFail(const QString &message) {
+	if (renderEnabled)
+		QMessageBox::information(window(), tr("XML Editor"), message);
 	else
-		return attr.value();
+		readError = message;
+}
+
+QString fetchElement(const QDomElement &element, const QString &name) {
+	return element.attribute(name);
 }
 
-qint64 fetchElementInt(QDomElement element, QString name, bool *success) {
-	QString s = fetchElement(element, name);
-	return s.toLongLong(success);
+qint64 fetchElementInt(const QDomElement &element, const QString &name, bool *success) {
+	return element.attribute(name).toLongLong(success);
 }
 
 qint64 XmlEdit::fetchId(ParseState &state, QDomElement element) {
 	bool tempSuccess;
-	qint64 id = fetchElementInt(element, "id", &tempSuccess);
+	qint64 id = fetchElementInt(element, QStringLiteral("id"), &tempSuccess);
 	if (!tempSuccess) {
-		addNodeFail(state, QString(tr("Couldn't understand attempt id: \"%1\"")).arg(fetchElement(element, "id")));
+		addNodeFail(state, QString(tr("Couldn't understand attempt id: \"%1\"")).arg(fetchElement(element, QStringLiteral("id"))));
 		return 0;
 	}
 	return id;
@@ -226,115 +340,153 @@ void SingleRun::ensureSpaceFor(int splitIdx) {
 		this->splits.push_back(SingleSplit());
 }
 
-void XmlEdit::addNode(ParseState &state, int depth, QWidget *content, QVBoxLayout *vContentLayout) {
-	QDomNode &node = state.node;
+// Map a tag name to its ParseTag. The table is built on first use and only read after that.
+static ParseTag parseTag(const QString &tag) {
+	static const QHash<QString, ParseTag> tags = {
+		{QStringLiteral("AttemptHistory"), TAG_ATTEMPT_HISTORY},
+		{QStringLiteral("Segments"), TAG_SEGMENTS},
+		{QStringLiteral("GameName"), TAG_GAME_NAME},
+		{QStringLiteral("CategoryName"), TAG_CATEGORY_NAME},
+		{QStringLiteral("AttemptCount"), TAG_ATTEMPT_COUNT},
+		{QStringLiteral("Offset"), TAG_OFFSET},
+		{QStringLiteral("Attempt"), TAG_ATTEMPT},
+		{QStringLiteral("RealTime"), TAG_REAL_TIME},
+		{QStringLiteral("GameTime"), TAG_GAME_TIME},
+		{QStringLiteral("Segment"), TAG_SEGMENT},
+		{QStringLiteral("Name"), TAG_NAME},
+		{QStringLiteral("SplitTimes"), TAG_SPLIT_TIMES},
+		{QStringLiteral("SplitTime"), TAG_SPLIT_TIME},
+		{QStringLiteral("BestSegmentTime"), TAG_BEST_SEGMENT_TIME},
+		{QStringLiteral("SegmentHistory"), TAG_SEGMENT_HISTORY},
+		{QStringLiteral("Time"), TAG_TIME},
+	};
+	return tags.value(tag, TAG_OTHER);
+}
+
+// next[kind][tag] is the state an element with that tag puts its children in.
+// Side effects of entering a state (ids, topSegment, DOM handles) live in addNode.
+struct ParseTransitionTable {
+	quint8 next[PARSING_KIND_COUNT][PARSE_TAG_COUNT];
+};
+static_assert(PARSING_KIND_COUNT <= 256, "ParseStateKind must fit in a transition table cell");
+
+static constexpr ParseTransitionTable buildParseTransitions() {
+	ParseTransitionTable t {};
+	for (int kind = 0; kind < PARSING_KIND_COUNT; kind++)
+		for (int tag = 0; tag < PARSE_TAG_COUNT; tag++)
+			t.next[kind][tag] = kind; // By default, elements we don't recognize inherit the state
+
+	for (int tag = 0; tag < PARSE_TAG_COUNT; tag++) {
+		t.next[PARSING_ROOT][tag] = PARSING_TOPLEVEL; // Whatever the root is called
+		t.next[PARSING_TOPLEVEL][tag] = PARSING_NONE; // Uninteresting toplevel elements are skipped
+	}
+	t.next[PARSING_TOPLEVEL][TAG_ATTEMPT_HISTORY] = PARSING_ATTEMPT_SCAN;
+	t.next[PARSING_TOPLEVEL][TAG_SEGMENTS] = PARSING_SEGMENT_SCAN;
+	t.next[PARSING_TOPLEVEL][TAG_GAME_NAME] = PARSING_STANDALONE;
+	t.next[PARSING_TOPLEVEL][TAG_CATEGORY_NAME] = PARSING_STANDALONE;
+	t.next[PARSING_TOPLEVEL][TAG_ATTEMPT_COUNT] = PARSING_STANDALONE;
+	t.next[PARSING_TOPLEVEL][TAG_OFFSET] = PARSING_STANDALONE;
+
+	t.next[PARSING_ATTEMPT_SCAN][TAG_ATTEMPT] = PARSING_ATTEMPT_INSIDE;
+	t.next[PARSING_ATTEMPT_INSIDE][TAG_REAL_TIME] = PARSING_ATTEMPT_REALTIME;
+	t.next[PARSING_ATTEMPT_INSIDE][TAG_GAME_TIME] = PARSING_ATTEMPT_REALTIME;
+
+	t.next[PARSING_SEGMENT_SCAN][TAG_SEGMENT] = PARSING_SEGMENT;
+	t.next[PARSING_SEGMENT][TAG_NAME] = PARSING_SEGMENT_NAME;
+	t.next[PARSING_SEGMENT][TAG_SPLIT_TIMES] = PARSING_SEGMENT_SPLITTIMES;
+	t.next[PARSING_SEGMENT][TAG_BEST_SEGMENT_TIME] = PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME;
+	t.next[PARSING_SEGMENT][TAG_SEGMENT_HISTORY] = PARSING_SEGMENT_HISTORY;
+	t.next[PARSING_SEGMENT_SPLITTIMES][TAG_SPLIT_TIME] = PARSING_SEGMENT_COMPARISON;
+	t.next[PARSING_SEGMENT_COMPARISON][TAG_REAL_TIME] = PARSING_SEGMENT_COMPARISON_REALTIME;
+	t.next[PARSING_SEGMENT_COMPARISON][TAG_GAME_TIME] = PARSING_SEGMENT_COMPARISON_REALTIME;
+	t.next[PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME][TAG_REAL_TIME] = PARSING_SEGMENT_BESTSPLIT_REALTIME;
+	t.next[PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME][TAG_GAME_TIME] = PARSING_SEGMENT_BESTSPLIT_REALTIME;
+	t.next[PARSING_SEGMENT_HISTORY][TAG_TIME] = PARSING_SEGMENT_HISTORY_RUN;
+	t.next[PARSING_SEGMENT_HISTORY_RUN][TAG_REAL_TIME] = PARSING_SEGMENT_HISTORY_RUN_REALTIME;
+	t.next[PARSING_SEGMENT_HISTORY_RUN][TAG_GAME_TIME] = PARSING_SEGMENT_HISTORY_RUN_REALTIME;
+	return t;
+}
+static constexpr ParseTransitionTable parseTransitions = buildParseTransitions();
 
+void XmlEdit::addNode(ParseState &state, const QDomNode &node, QWidget *content, QVBoxLayout *vContentLayout) {
 	switch(node.nodeType()) {
 		case QDomNode::ElementNode: {
 			QDomElement element = node.toElement();
-			QString tag = element.tagName();
+			ParseTag tag = parseTag(element.tagName());
+			ParseStateKind next = ParseStateKind(parseTransitions.next[state.kind][tag]);
+			if (next == state.kind)
+				break;
 
-			switch(state.kind) {
-				case PARSING_NONE: // Toplevel
-					if (depth == 2) {
-						if (tag == "AttemptHistory") {
-							state.kind = PARSING_ATTEMPT_SCAN;
-						} else if (tag == "Segments") {
-							state.kind = PARSING_SEGMENT_SCAN;
-							topSegment = -1;
-						} else if (standaloneKeys.count(tag)) {
-							state.kind = PARSING_STANDALONE;
-							state.str1 = standaloneKeys[tag];
-						}
-					} break;
-				case PARSING_ATTEMPT_SCAN: {
-					if (tag == "Attempt") { // We have found an attempt, set it up in run keys
-						qint64 id = fetchId(state, element);
-						if (state.dead) return;
-
-						runKeys.append(id);
-						SingleRun &run = runs[id];
-						run.timeLabel = fetchElement(element, "started");
-						state.kind = PARSING_ATTEMPT_INSIDE;
-						state.int1 = id;
-					}
+			// Entering a new state, do whatever bookkeeping it needs
+			switch(next) {
+				case PARSING_STANDALONE: // One of the toplevel values with an edit box
+					state.int1 = tag;
+					break;
+				case PARSING_ATTEMPT_INSIDE: { // We have found an attempt, set it up in run keys
+					qint64 id = fetchId(state, element);
+					if (state.dead) return;
+
+					runKeys.append(id);
+					SingleRun &run = runs[id];
+					run.id = id;
+					run.timeLabel = fetchElement(element, QStringLiteral("started"));
+					state.int1 = id;
 				} break;
-				case PARSING_ATTEMPT_INSIDE: // In <Attempt> looking for <AttemptHistory>
-					if (tag == "RealTime") {
-						state.kind = PARSING_ATTEMPT_REALTIME;
-					} break;
-				case PARSING_SEGMENT_SCAN: // In <Segments> looking for <Segment>
-					if (tag == "Segment") {
-						topSegment++;
-						state.kind = PARSING_SEGMENT;
-					} break;
-				case PARSING_SEGMENT: { // In <Segment> looking for one of several things
-					if (tag == "Name") {
-						state.kind = PARSING_SEGMENT_NAME;
-					} else if (tag == "SplitTimes") {
-						state.kind = PARSING_SEGMENT_PB_SPLITTIMES;
-					} else if (tag == "BestSegmentTime") {
-						// Notice: Run ID is specified explicitly but split ID is always implicit by XML order
-						bestSplits.ensureSpaceFor(topSegment);
-						SingleSplit &split = bestSplits.splits[topSegment];
-
-						state.kind = PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME;
-						split.timeXml = element;
-					} else if (tag == "SegmentHistory") {
-						state.kind = PARSING_SEGMENT_HISTORY;
-					}
+				case PARSING_SEGMENT_SCAN:
+					topSegment = -1;
+					break;
+				case PARSING_SEGMENT:
+					topSegment++;
+					break;
+				case PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME: {
+					// Notice: Run ID is specified explicitly but split ID is always implicit by XML order
+					bestSplits.ensureSpaceFor(topSegment);
+					SingleSplit &split = bestSplits.splits[topSegment];
+					split.timeXml = element;
+					split.method = timingMethod;
 				} break;
-			    case PARSING_SEGMENT_PB_SPLITTIMES: // In <SplitTimes> looking for <SplitTime name="Personal Best">
-					if (tag == "SplitTime") {
-						QString name = fetchElement(element, "name");
-						if (name == "Personal Best") {
-							bestRun.ensureSpaceFor(topSegment);
-							SingleSplit &split = bestRun.splits[topSegment];
-
-							state.kind = PARSING_SEGMENT_PB_SPLITTIME;
-							split.timeXml = element;
-							split.xmlIsTotal = true; // For whatever reason this is how LiveSplit measures PBs
-						}
-					} break;
-				case PARSING_SEGMENT_PB_SPLITTIME: // In <SplitTimes><SplitTime name="Personal Best"> looking for <RealTime>
-					if (tag == "RealTime") {
-						SingleSplit &split = bestRun.splits[topSegment];
-
-						state.kind = PARSING_SEGMENT_PB_REALTIME;
-						split.realTimeXml = element;
-					} break;
-		        case PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME: // In <BestSegmentTime> looking for <RealTime>
-		        	if (tag == "RealTime") {
-		        		SingleSplit &split = bestSplits.splits[topSegment];
-
-						state.kind = PARSING_SEGMENT_BESTSPLIT_REALTIME;
-						split.realTimeXml = element;
-					} break;
-		        case PARSING_SEGMENT_HISTORY: // In <SegmentHistory> looking for <Time>
-		        	if (tag == "Time") { // We have now found data from an actual run
-						qint64 id = fetchId(state, element); // Run id
-						if (state.dead) return;
-
-						// Create data structure for run
-						SingleRun &run = runs[id];
-						Q_ASSERT_X(topSegment >= 0, "XML parse", "topSegment is uninitialized");
-						run.ensureSpaceFor(topSegment);
-						SingleSplit &split = run.splits[topSegment];
-						split.timeXml = element; // Need to save this if deletion is needed later
-
-						state.kind = PARSING_SEGMENT_HISTORY_RUN;
-						state.int1 = id;
-					} break;
-    			case PARSING_SEGMENT_HISTORY_RUN: // In <SegmentHistory><Time> looking for <RealTime>
-		        	if (tag == "RealTime") {
-						SingleRun &run = runs[state.int1];
-						SingleSplit &split = run.splits[topSegment];
+				case PARSING_SEGMENT_COMPARISON: { // <SplitTime name="...">, each comparison has its own column
+					int index = comparisonIndex(fetchElement(element, QStringLiteral("name")));
+					SingleRun &column = comparisonRun(index);
+					column.ensureSpaceFor(topSegment);
+					SingleSplit &split = column.splits[topSegment];
+					split.timeXml = element;
+					split.xmlIsTotal = true; // For whatever reason this is how LiveSplit measures PBs
+					split.method = timingMethod;
+					state.int1 = index;
+				} break;
+				case PARSING_SEGMENT_COMPARISON_REALTIME:
+				case PARSING_SEGMENT_BESTSPLIT_REALTIME:
+				case PARSING_SEGMENT_HISTORY_RUN_REALTIME: {
+					SingleSplit &split = next == PARSING_SEGMENT_COMPARISON_REALTIME ? comparisonRun(state.int1).splits[topSegment]
+						: next == PARSING_SEGMENT_BESTSPLIT_REALTIME ? bestSplits.splits[topSegment]
+						: runs[state.int1].splits[topSegment];
+					state.method = tag == TAG_GAME_TIME ? TIMING_GAME : TIMING_REAL;
+					if (state.method == timingMethod)
 						split.realTimeXml = element; // Need to save this if deletion is needed later
-
-						state.kind = PARSING_SEGMENT_HISTORY_RUN_REALTIME;
-					} break;
+					else
+						split.otherXml = element;
+				} break;
+				case PARSING_ATTEMPT_REALTIME:
+					state.method = tag == TAG_GAME_TIME ? TIMING_GAME : TIMING_REAL;
+					break;
+				case PARSING_SEGMENT_HISTORY_RUN: { // We have now found data from an actual run
+					qint64 id = fetchId(state, element); // Run id
+					if (state.dead) return;
+
+					// Create data structure for run
+					SingleRun &run = runs[id];
+					run.id = id;
+					Q_ASSERT_X(topSegment >= 0, "XML parse", "topSegment is uninitialized");
+					run.ensureSpaceFor(topSegment);
+					SingleSplit &split = run.splits[topSegment];
+					split.timeXml = element; // Need to save this if deletion is needed later
+					split.method = timingMethod;
+					state.int1 = id;
+				} break;
 				default:break;
 			}
+			state.kind = next;
 		} break;
 		case QDomNode::TextNode: {
 			QDomCharacterData text = node.toCharacterData();
@@ -342,7 +494,9 @@ void XmlEdit::addNode(ParseState &state, int depth, QWidget *content, QVBoxLayou
 			switch(state.kind) {
 				case PARSING_STANDALONE: { // One of the XML parameters that's in a standalone edit box at the top
 					// The standalone boxes are the only ones we layout in this initial XML-parsing pass
-					QString label = state.str1;
+					if (!renderEnabled)
+						break;
+					QString label = standaloneLabels.value(state.int1);
 
 					QWidget *assign = new QWidget(content);
 					QHBoxLayout *hAssignLayout = new QHBoxLayout(assign);
@@ -357,18 +511,27 @@ void XmlEdit::addNode(ParseState &state, int depth, QWidget *content, QVBoxLayou
 					hAssignLayout->addWidget(assignEdit);
 					//assignEdit->setFixedWidth(38*columnWidth);
 					assignEdit->setText(text.data());
-					new ShortCharacterDataWatcher(assignEdit, text);
+					if (readOnly) // There'll be no DOM to write to
+						assignEdit->setReadOnly(true);
+					else {
+						new ShortCharacterDataWatcher(assignEdit, text);
+						connect(assignEdit, &QLineEdit::textChanged, this, [this, text]() { touchSaved(text); });
+					}
+					standaloneEdits[state.int1] = assignEdit;
 				} break;
 				case PARSING_ATTEMPT_REALTIME: { // Found the "total time" for a run, save position to edit later
 					SingleRun &run = runs[state.int1];
-					run.realTimeTotal = text;
+					if (state.method == timingMethod)
+						run.realTimeTotal = text;
+					else
+						run.otherTotal = text;
 				} break;
 				case PARSING_SEGMENT_NAME: { // Found a segment name
 					while (splitNames.size() < topSegment)
 						splitNames.append(QString());
 					splitNames.append(text.data());
 				} break;
-				case PARSING_SEGMENT_PB_REALTIME: // Found a split time
+				case PARSING_SEGMENT_COMPARISON_REALTIME: // Found a split time
 				case PARSING_SEGMENT_BESTSPLIT_REALTIME:
 				case PARSING_SEGMENT_HISTORY_RUN_REALTIME: {
 					bool success;
@@ -377,29 +540,22 @@ void XmlEdit::addNode(ParseState &state, int depth, QWidget *content, QVBoxLayou
 						addNodeFail(state, QString(tr("Couldn't parse time: \"%1\"")).arg(text.data()));
 						break;
 					}
-					switch(state.kind) {
-						case PARSING_SEGMENT_HISTORY_RUN_REALTIME: { // It's from a run
-							SingleRun &run = runs[state.int1];
-							SingleSplit &split = run.splits[topSegment];
-							split.textXml = text;
-							split.splitHas = true;
-							split.splitUs = time;
-						} break;
-						case PARSING_SEGMENT_PB_REALTIME: { // It's from the PB record
-							SingleSplit &split = bestRun.splits[topSegment];
-							split.textXml = text;
-							split.totalHas = true; // Again notice PB XML is recorded as total
-							split.totalUs = time;
-						} break;
-						case PARSING_SEGMENT_BESTSPLIT_REALTIME: { // It's a best split
-							SingleSplit &split = bestSplits.splits[topSegment];
-							split.textXml = text;
-							split.splitHas = true;
-							split.splitUs = time;
-						} break;
-						default: {
-							Q_ASSERT_X(false, "time parse", "Unreachable code reached");
-						} break;
+					// From a run, from the PB or another comparison (again notice that XML is a total), or a best split
+					SingleSplit &split = state.kind == PARSING_SEGMENT_COMPARISON_REALTIME ? comparisonRun(state.int1).splits[topSegment]
+						: state.kind == PARSING_SEGMENT_BESTSPLIT_REALTIME ? bestSplits.splits[topSegment]
+						: runs[state.int1].splits[topSegment];
+					if (state.method != timingMethod) { // Kept for when the user switches
+						split.otherTextXml = text;
+						split.otherHas = true;
+						split.otherUs = time;
+					} else if (split.xmlIsTotal) {
+						split.textXml = text;
+						split.totalHas = true;
+						split.totalUs = time;
+					} else {
+						split.textXml = text;
+						split.splitHas = true;
+						split.splitUs = time;
 					}
 				}
 				default:break;
@@ -423,7 +579,7 @@ void XmlEdit::addNode(ParseState &state, int depth, QWidget *content, QVBoxLayou
 	}
 }
 
-void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBoxLayout *vContentLayout) {
+void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QLayout *vContentLayout) {
 	{
 		QFrame *line = new QFrame(content); // Magic <hr> code from Stack Overflow
 		line->setObjectName(QString::fromUtf8("line"));
@@ -431,6 +587,7 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
 		line->setFrameShape(QFrame::HLine);
 		line->setFrameShadow(QFrame::Sunken);
 		vContentLayout->addWidget(line);
+		run.ruleWidget = line;
 	}
 
 	{ // Run labels
@@ -441,6 +598,7 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
 		QLabel *label = new QLabel(labelHbox);
 		label->setText(runLabel);
 		labelHLayout->addWidget(label);
+		run.titleWidget = label;
 
 		QLabel *totalTime = new QLabel(labelHbox);
 		QString realTimeTotalString = run.realTimeTotal.data();
@@ -454,7 +612,23 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
 	}
 
 	if (run.splits.size()) { // Split table (if any)
-		QTableWidget *table = new TableWidgetNoScroll(run.splits.size(), 3, content);
+		bool attempt = run.id != RUN_ID_PERSONAL_BEST && run.id != RUN_ID_BEST_SPLITS;
+		if (attempt && lazyTableLimit) { // Built once it's on screen, see buildLazyTable
+			QWidget *placeholder = new QWidget(content);
+			placeholder->setFixedHeight(tableHeight(run.splits.size()));
+			vContentLayout->addWidget(placeholder);
+			run.placeholderWidget = placeholder;
+		} else {
+			vContentLayout->addWidget(renderTable(run, content));
+		}
+	}
+}
+
+// The table part of renderRun, not yet in any layout
+QTableWidget *XmlEdit::renderTable(SingleRun &run, QWidget *content) {
+	{ // Split table
+		bool attempt = run.id != RUN_ID_PERSONAL_BEST && run.id != RUN_ID_BEST_SPLITS;
+		QTableWidget *table = new TableWidgetNoScroll(run.splits.size(), attempt ? RUN_TABLE_COLUMNS : COLUMN_DELTA_PB, content);
     	table->setSizeAdjustPolicy(QAbstractScrollArea::AdjustToContents); // DOES ANYTHING??
 		table->setHorizontalHeaderLabels(runTableLabels);
 
@@ -492,6 +666,8 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
     			if (split.splitHas)
     				splitTime->setText(usToStr(split.splitUs));
     			splitTime->setTextAlignment(Qt::AlignRight|Qt::AlignVCenter);
+    			if (readOnly)
+    				splitTime->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
     		}
     		table->setItem(sidx, 1, splitTime);
     		split.splitTimeWidget = splitTime;
@@ -500,6 +676,8 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
     		totalTime->setFont(monoFont);
     		if (!allValid) { // Right now, if there are any invalid splits, editing a total time after this will confuse the app.
     			totalTime->setFlags(0); // So just don't let that happen.
+    		} else if (readOnly) {
+    			totalTime->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
     		}
     		if (!valid) { // File has been edited in split editor -- not valid
     			totalTime->setText("-----");
@@ -532,20 +710,38 @@ void XmlEdit::renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBo
     		table->setColumnWidth(0, columnWidthName);
     		table->setColumnWidth(1, columnWidthTime);
     		table->setColumnWidth(2, columnWidthTime);
+    		if (attempt) {
+    			table->setColumnWidth(COLUMN_DELTA_PB, columnWidthTime);
+    			table->setColumnWidth(COLUMN_DELTA_GOLD, columnWidthTime);
+    		}
+    	}
+
+    	// Delta cells are made when they first come on screen
+    	if (attempt && !deltaColumns) {
+    		table->setColumnHidden(COLUMN_DELTA_PB, true);
+    		table->setColumnHidden(COLUMN_DELTA_GOLD, true);
     	}
 
     	// Watch for changes, this routes to ::changed below
 		new XmlEditTableWatcher(table, this, run);
+		table->setProperty("runId", run.id); // For the clipboard, which finds tables by focus
+#ifndef QT_NO_CLIPBOARD
+		connect(table, &QTableWidget::itemSelectionChanged, this, [this, table]() {
+			emit copyAvailable(!table->selectedRanges().isEmpty());
+		});
+#endif
 
-    	vContentLayout->addWidget(table);
     	run.tableWidget = table;
-    }
+    	return table;
+	}
 }
 
 void XmlEditTableWatcher::changed(QTableWidgetItem *item) {
 	// printf("DEBUG- ::CHANGED! row %d col %d correctingTable? %s data %s\n", item->row(), item->column(), xmlEdit->correctingTable?"Y":"N", item->text().toStdString().c_str());
 	if (xmlEdit->correctingTable) // This slot is for catching changes by the user.
 		return;          // If we set a change off ourselves, ignore it.
+	if (item->column() != COLUMN_SPLIT && item->column() != COLUMN_TOTAL)
+		return;
 
 	// Interpret cell
 	QString text = item->text();
@@ -589,6 +785,11 @@ void XmlEditTableWatcher::changed(QTableWidgetItem *item) {
 	if (success || empty) {
 		// Clear error icon
 		item->setIcon(xmlEdit->nullIcon);
+		// Remember what was there, for undo
+		bool oldHas = cellIsTotal ? split.totalHas : split.splitHas;
+		UndoEdit undoEdit = {run.id, item->row(), quint8(item->column()),
+			quint8((oldHas ? UNDO_OLD_PRESENT : 0) | (empty ? 0 : UNDO_NEW_PRESENT)),
+			oldHas ? (cellIsTotal ? split.totalUs : split.splitUs) : 0, empty ? 0 : us};
 		// Copy us value back into split
 		if (cellIsTotal) {
 			split.totalHas = !empty;
@@ -599,17 +800,21 @@ void XmlEditTableWatcher::changed(QTableWidgetItem *item) {
 		}
 		// Set underlying DOM element (if any)
 		if (cellIsTotal == split.xmlIsTotal)
-			split.write(xmlEdit->domDocument);
+			xmlEdit->writeSplit(split);
 		// Whichever column we just changed, correct the other side
 		xmlEdit->correctTable(run, cellIsTotal, true);
+		xmlEdit->invalidateDeltas(run, item->row(), cellIsTotal ? item->row() + 1 : run.splits.size() - 1);
+
+		// Remember the edit for autosave
+		JournalEdit edit = {run.id, item->row(), quint8(item->column()), !empty, us};
+		xmlEdit->journal.record(edit);
+		xmlEdit->pushHistory({undoEdit});
 
 		// Edited last row, change total time also
-		if (cellIsTotal && item->row() == (run.splits.size()-1) && run.splits.size() == xmlEdit->runTableLabels.size()) {
-    		if (!run.realTimeTotal.isNull())
-	    		run.realTimeTotal.setData(empty ? QString() : usToStr(us));
-    		if (run.realTimeTotalWidget)
-	    		run.realTimeTotalWidget->setText(empty ? QString() : REALTIME_TOTAL_STR(usToStr(us)));
-    	}
+		if (cellIsTotal && item->row() == (run.splits.size()-1))
+			xmlEdit->setFinalTotal(run, !empty, us);
+
+		xmlEdit->setModified(true);
 
 	// There's text in the cell but it's garbage, show the error icon
 	} else {
@@ -618,78 +823,651 @@ void XmlEditTableWatcher::changed(QTableWidgetItem *item) {
 }
 
 bool XmlEdit::isModified() const {
-	return false;
+	return modified;
+}
+
+void XmlEdit::setModified(bool m) {
+	if (m) {
+		editGeneration++;
+		emit dataChanged();
+	}
+	if (modified == m)
+		return;
+	modified = m;
+	emit contentsChanged();
+}
+
+SingleRun *XmlEdit::runForId(qint64 id) {
+	switch (id) {
+		case RUN_ID_PERSONAL_BEST: return &bestRun;
+		case RUN_ID_BEST_SPLITS: return &bestSplits;
+		default: {
+			if (id >= 1 && id <= runsById.size())
+				return runsById[id - 1];
+			auto found = runs.find(id);
+			return found == runs.end() ? NULL : &found.value();
+		}
+	}
+}
+
+// Once the attempt ids are 1..N in file order, as compactIds leaves them, attempts are looked
+// up by position instead of by hashing. runs doesn't move its values, so the pointers hold
+void XmlEdit::indexRuns() {
+	runsById.clear();
+	for (int ridx = 0; ridx < runKeys.size(); ridx++)
+		if (runKeys[ridx] != ridx + 1)
+			return;
+	runsById.reserve(runKeys.size());
+	for (qint64 id : runKeys)
+		runsById.append(&runs[id]);
+}
+
+// Column for comparison name, added the first time the name is seen
+int XmlEdit::comparisonIndex(const QString &name) {
+	int index = comparisonNames.indexOf(name);
+	if (index < 0) {
+		index = comparisonNames.size();
+		comparisonNames.append(name);
+		comparisons.append(SingleRun());
+		if (name == shownComparisonName)
+			shownComparison = index;
+	}
+	return index;
+}
+
+// The Personal Best (or the comparison shown in its place) and every other comparison, all of
+// which the file keeps as totals. names, if given, gets each one's <SplitTime name>
+QVector<SingleRun *> XmlEdit::comparisonColumns(QStringList *names) {
+	QVector<SingleRun *> columns;
+	columns.append(&bestRun);
+	if (names)
+		*names = QStringList(shownComparisonName);
+	for (int index = 0; index < comparisons.size(); index++) {
+		if (index == shownComparison) // An empty placeholder, bestRun has it
+			continue;
+		columns.append(&comparisons[index]);
+		if (names)
+			names->append(comparisonNames[index]);
+	}
+	return columns;
+}
+
+// Give every comparison column as many rows as the longest, so any of them fits the table
+void XmlEdit::padComparisons() {
+	int count = bestRun.splits.size();
+	for (const SingleRun &column : comparisons)
+		count = qMax(count, column.splits.size());
+	bestRun.ensureSpaceFor(count - 1);
+	for (SingleRun &column : comparisons)
+		column.ensureSpaceFor(count - 1);
+}
+
+// After a run's times were swapped out from under its table: work out the side that isn't in
+// the XML and show everything, including the final time
+void XmlEdit::refreshRun(SingleRun &run, bool truthIsTotal) {
+	if (truthIsTotal)
+		splitsFromTotals(run);
+	else
+		totalsFromSplits(run);
+	showSplits(run);
+	if (run.realTimeTotalWidget && run.id != RUN_ID_PERSONAL_BEST && run.id != RUN_ID_BEST_SPLITS) {
+		QString total = run.realTimeTotal.data();
+		if (released && run.splits.size() == splitNames.size() && !run.splits.isEmpty() && run.splits.last().totalHas)
+			total = usToStr(run.splits.last().totalUs); // Which is what the file's final time has to be
+		run.realTimeTotalWidget->setText(total.isEmpty() ? total : REALTIME_TOTAL_STR(total));
+	}
+}
+
+// Show the other timing method everywhere. Both were parsed, so this only swaps them
+void XmlEdit::setTimingMethod(TimingMethod method) {
+	if (method == timingMethod)
+		return;
+	timingMethod = method;
+	swapRunTimingMethod(bestRun);
+	swapRunTimingMethod(bestSplits);
+	for (SingleRun &column : comparisons)
+		swapRunTimingMethod(column);
+	for (SingleRun &run : runs)
+		swapRunTimingMethod(run);
+
+	if (!renderEnabled || !vLayout)
+		return;
+	widget()->setUpdatesEnabled(false);
+	refreshRun(bestRun, true);
+	refreshRun(bestSplits, false);
+	for (SingleRun &run : runs)
+		refreshRun(run, false);
+	widget()->setUpdatesEnabled(true);
+	invalidateAllDeltas();
+	if (sortKey == SORT_FINAL_TIME || sortKey == SORT_SEGMENT_TIME)
+		applySort();
+	clearHistory(); // Its times are the other method's
+	emit dataChanged();
+}
+
+// Show comparison index in the Personal Best's place
+void XmlEdit::setComparison(int index) {
+	if (index < 0 || index >= comparisons.size() || index == shownComparison)
+		return;
+	swapComparison(bestRun, comparisons[shownComparison]); // Put the shown one back...
+	swapComparison(bestRun, comparisons[index]); // ...and take out the new one
+	shownComparison = index;
+	shownComparisonName = comparisonNames[index];
+	if (bestRun.titleWidget)
+		bestRun.titleWidget->setText(comparisonTitle(shownComparisonName));
+	refreshRun(bestRun, true);
+	invalidateAllDeltas();
+	clearHistory(); // Its Personal Best times are the other comparison's
+	emit dataChanged();
+}
+
+// Re-type each journaled edit into its cell, so it goes through XmlEditTableWatcher::changed
+// exactly as the original edit did. Edits that no longer fit the document are skipped.
+int XmlEdit::replayJournal(const QVector<JournalEdit> &edits) {
+	int applied = 0;
+	for(const JournalEdit &edit : edits) {
+		SingleRun *run = runForId(edit.runId);
+		if (!run || edit.row < 0 || edit.row >= run->splits.size())
+			continue;
+		buildLazyTable(*run);
+		SingleSplit &split = run->splits[edit.row];
+		QTableWidgetItem *item = edit.column == 2 ? split.totalTimeWidget : split.splitTimeWidget;
+		if (!item || !(item->flags() & Qt::ItemIsEditable))
+			continue;
+		item->setText(edit.present ? usToStr(edit.us) : QString());
+		applied++;
+	}
+	return applied;
 }
 
 #ifndef QT_NO_CLIPBOARD
-void XmlEdit::cut() {
+// The run table with keyboard focus, if any
+QTableWidget *XmlEdit::focusedTable(SingleRun **run) {
+	for (QWidget *w = QApplication::focusWidget(); w; w = w->parentWidget()) {
+		QTableWidget *table = qobject_cast<QTableWidget *>(w);
+		if (table && table->property("runId").isValid()) {
+			*run = runForId(table->property("runId").toLongLong());
+			return *run ? table : NULL;
+		}
+	}
+	return NULL;
+}
 
+// Selected cells as TSV, covering the rectangle around every selected range
+static QString selectionTsv(QTableWidget *table) {
+	QList<QTableWidgetSelectionRange> ranges = table->selectedRanges();
+	if (ranges.isEmpty())
+		return QString();
+	int top = ranges[0].topRow(), bottom = ranges[0].bottomRow();
+	int left = ranges[0].leftColumn(), right = ranges[0].rightColumn();
+	for (const QTableWidgetSelectionRange &range : ranges) {
+		top = qMin(top, range.topRow());
+		bottom = qMax(bottom, range.bottomRow());
+		left = qMin(left, range.leftColumn());
+		right = qMax(right, range.rightColumn());
+	}
+
+	QString tsv;
+	for (int row = top; row <= bottom; row++) {
+		for (int column = left; column <= right; column++) {
+			QTableWidgetItem *item = table->item(row, column);
+			if (column > left)
+				tsv += '\t';
+			if (item && item->isSelected())
+				tsv += item->text();
+		}
+		tsv += '\n';
+	}
+	return tsv;
 }
-void XmlEdit::copy() {
 
+void XmlEdit::cut() {
+	SingleRun *run;
+	QTableWidget *table = focusedTable(&run);
+	if (!table)
+		return;
+	QApplication::clipboard()->setText(selectionTsv(table));
+
+	QVector<CellEdit> edits;
+	for (QTableWidgetItem *item : table->selectedItems())
+		edits.append({item->row(), item->column(), QString()});
+	QString errorString;
+	if (!applyCellEdits(*run, edits, &errorString))
+		QMessageBox::information(window(), tr("XML Editor"), errorString);
 }
+
+void XmlEdit::copy() {
+	SingleRun *run;
+	QTableWidget *table = focusedTable(&run);
+	if (table)
+		QApplication::clipboard()->setText(selectionTsv(table));
+}
+
+// Paste a TSV block with its top left corner at the selection
 void XmlEdit::paste() {
+	SingleRun *run;
+	QTableWidget *table = focusedTable(&run);
+	if (!table)
+		return;
+	int top = table->currentRow(), left = table->currentColumn();
+	QList<QTableWidgetSelectionRange> ranges = table->selectedRanges();
+	if (!ranges.isEmpty()) {
+		top = ranges[0].topRow();
+		left = ranges[0].leftColumn();
+	}
+	if (top < 0 || left < 0)
+		return;
+
+	QString text = QApplication::clipboard()->text();
+	if (text.endsWith('\n'))
+		text.chop(1);
+	QVector<CellEdit> edits;
+	QStringList lines = text.split('\n');
+	for (int lidx = 0; lidx < lines.size(); lidx++) {
+		QString line = lines[lidx];
+		if (line.endsWith('\r'))
+			line.chop(1);
+		QStringList cells = line.split('\t');
+		for (int cidx = 0; cidx < cells.size(); cidx++)
+			edits.append({top + lidx, left + cidx, cells[cidx].trimmed()});
+	}
 
+	QString errorString;
+	if (!applyCellEdits(*run, edits, &errorString))
+		QMessageBox::information(window(), tr("XML Editor"), errorString);
 }
 #endif
 
+// Apply many cell edits to one run at once: values go into the splits with
+// XmlEditTableWatcher::changed suppressed, then one correctTable pass and one
+// write of the DOM for the edited rows. Cells that can't be edited (names,
+// "missing" splits, past the last row) are ignored. If any value is bad,
+// nothing changes and errorString says why.
+bool XmlEdit::applyCellEdits(SingleRun &run, const QVector<CellEdit> &edits, QString *errorString) {
+	buildLazyTable(run); // The cells decide what's editable
+	struct Parsed { int row; bool cellIsTotal; bool present; uint64_t us; };
+	QVector<Parsed> parsed;
+	bool anySplit = false, anyTotal = false;
+	for (const CellEdit &edit : edits) {
+		if (edit.row < 0 || edit.row >= run.splits.size() || (edit.column != 1 && edit.column != 2))
+			continue;
+		SingleSplit &split = run.splits[edit.row];
+		QTableWidgetItem *item = edit.column == 2 ? split.totalTimeWidget : split.splitTimeWidget;
+		if (!item || !(item->flags() & Qt::ItemIsEditable))
+			continue;
+		Parsed value = {edit.row, edit.column == 2, !edit.text.isEmpty(), 0};
+		if (value.present) {
+			bool success;
+			value.us = strToUs(edit.text, &success);
+			if (!success) {
+				*errorString = tr("Couldn't parse time: \"%1\"").arg(edit.text);
+				return false;
+			}
+		}
+		anySplit = anySplit || !value.cellIsTotal;
+		anyTotal = anyTotal || value.cellIsTotal;
+		parsed.append(value);
+	}
+	if (parsed.isEmpty())
+		return true;
+	// If split times were given, they decide the totals. Otherwise the totals decide the splits
+	bool truthIsTotal = anyTotal && !anySplit;
+
+	QVector<SingleSplit> before = run.splits;
+	QVector<bool> edited(run.splits.size(), false);
+	for (const Parsed &value : parsed) {
+		if (value.cellIsTotal != truthIsTotal) // Would be overwritten by the correction anyway
+			continue;
+		edited[value.row] = true;
+		SingleSplit &split = run.splits[value.row];
+		if (value.cellIsTotal) {
+			split.totalHas = value.present;
+			split.totalUs = value.us;
+		} else {
+			split.splitHas = value.present;
+			split.splitUs = value.us;
+		}
+	}
+
+	// Make sure the clock never goes backward
+	if (truthIsTotal) {
+		uint64_t lastUs = 0;
+		for (const SingleSplit &split : run.splits) {
+			if (!split.totalHas)
+				continue;
+			if (split.totalUs < lastUs) {
+				run.splits = before;
+				*errorString = tr("Those total times would make the clock go backward");
+				return false;
+			}
+			lastUs = split.totalUs;
+		}
+	}
+
+	// Show the new values, then write each edited row to the DOM once
+	correctingTable = true;
+	for (const Parsed &value : parsed) {
+		if (value.cellIsTotal != truthIsTotal)
+			continue;
+		SingleSplit &split = run.splits[value.row];
+		QTableWidgetItem *item = value.cellIsTotal ? split.totalTimeWidget : split.splitTimeWidget;
+		item->setIcon(nullIcon);
+		item->setText(value.present ? usToStr(value.us) : QString());
+	}
+	correctingTable = false;
+	for (int row = 0; row < run.splits.size(); row++) {
+		SingleSplit &split = run.splits[row];
+		if (edited[row] && split.xmlIsTotal == truthIsTotal)
+			writeSplit(split);
+	}
+	correctTable(run, truthIsTotal, true);
+	int firstEdited = edited.indexOf(true);
+	if (firstEdited >= 0) // Totals change from the first edit down, splits only next to a changed total
+		invalidateDeltas(run, firstEdited, truthIsTotal ? qMin(edited.lastIndexOf(true) + 1, run.splits.size() - 1) : run.splits.size() - 1);
+
+	for (const Parsed &value : parsed) {
+		if (value.cellIsTotal != truthIsTotal)
+			continue;
+		JournalEdit edit = {run.id, value.row, quint8(value.cellIsTotal ? 2 : 1), value.present, value.us};
+		journal.record(edit);
+		if (value.cellIsTotal && value.row == run.splits.size()-1)
+			setFinalTotal(run, value.present, value.us);
+	}
+
+	// The whole paste is one undo
+	QVector<UndoEdit> group;
+	for (int row = 0; row < run.splits.size(); row++) {
+		if (!edited[row])
+			continue;
+		const SingleSplit &old = before[row], &now = run.splits[row];
+		bool oldHas = truthIsTotal ? old.totalHas : old.splitHas, newHas = truthIsTotal ? now.totalHas : now.splitHas;
+		group.append({run.id, row, quint8(truthIsTotal ? 2 : 1),
+			quint8((oldHas ? UNDO_OLD_PRESENT : 0) | (newHas ? UNDO_NEW_PRESENT : 0)),
+			oldHas ? (truthIsTotal ? old.totalUs : old.splitUs) : 0, newHas ? (truthIsTotal ? now.totalUs : now.splitUs) : 0});
+	}
+	pushHistory(group);
+	setModified(true);
+	return true;
+}
+
+void XmlEdit::pushHistory(const QVector<UndoEdit> &group) {
+	history.push(group);
+	emit undoAvailable(history.canUndo());
+	emit redoAvailable(history.canRedo());
+}
+
+void XmlEdit::clearHistory() {
+	history.clear();
+	emit undoAvailable(false);
+	emit redoAvailable(false);
+}
+
+void XmlEdit::undo() {
+	stepHistory(true);
+}
+
+void XmlEdit::redo() {
+	stepHistory(false);
+}
+
+// Put a group's cells back the way they were (or were made, to redo) through applyCellEdits,
+// a run at a time, so the tables, DOM, deltas and journal follow just as for a paste
+void XmlEdit::stepHistory(bool backward) {
+	QVector<UndoEdit> group;
+	if (!(backward ? history.takeUndo(group) : history.takeRedo(group)))
+		return;
+
+	QVector<qint64> order;
+	QHash<qint64, QVector<CellEdit>> edits;
+	for (const UndoEdit &edit : group) {
+		bool present = edit.presence & (backward ? UNDO_OLD_PRESENT : UNDO_NEW_PRESENT);
+		if (!edits.contains(edit.runId))
+			order.append(edit.runId);
+		edits[edit.runId].append({edit.row, edit.column, present ? usToStr(backward ? edit.oldUs : edit.newUs) : QString()});
+	}
+
+	history.setReplaying(true);
+	widget()->setUpdatesEnabled(false);
+	QString errorString;
+	for (qint64 id : order) {
+		SingleRun *run = runForId(id);
+		if (run && !applyCellEdits(*run, edits[id], &errorString))
+			break;
+	}
+	widget()->setUpdatesEnabled(true);
+	history.setReplaying(false);
+	if (!errorString.isEmpty())
+		QMessageBox::information(window(), tr("XML Editor"), errorString);
+	emit undoAvailable(history.canUndo());
+	emit redoAvailable(history.canRedo());
+}
+
+// The total time recorded on the run itself, which only a run that reached every split has
+void XmlEdit::setFinalTotal(SingleRun &run, bool present, uint64_t us) {
+	if (run.splits.size() != splitNames.size())
+		return;
+	if (!run.realTimeTotal.isNull()) {
+		run.realTimeTotal.setData(present ? usToStr(us) : QString());
+		touchSaved(run.realTimeTotal);
+	}
+	if (run.realTimeTotalWidget)
+		run.realTimeTotalWidget->setText(present ? REALTIME_TOTAL_STR(usToStr(us)) : QString());
+}
+
 bool XmlEdit::read(QIODevice *device) {
     QString errorStr;
     int errorLine;
     int errorColumn;
 
     clear();
+    readError.clear();
+
+    // Viewer mode keeps no DOM handles, so the segments, which are nearly all of a file, are read
+    // on every core at once and only what's around them goes through the DOM
+    QByteArray file;
+    QBuffer buffer(&file);
+    if (readOnly) {
+        file = device->readAll();
+        QByteArray skeleton;
+        QVector<ScannedSegment> segments;
+        if (splitSegments(file, &skeleton, &segments) && scanSegments(segments) && domDocument.setContent(skeleton, true)) {
+            if (!parseDocument(&segments))
+                return false;
+            releaseDocument();
+            return true;
+        }
+        buffer.open(QIODevice::ReadOnly); // The usual way takes anything the scan didn't, and reports any errors
+        device = &buffer;
+    } else { // Kept as the base the first save patches, see snapshot()
+        file = device->readAll();
+        buffer.open(QIODevice::ReadOnly);
+        device = &buffer;
+    }
 
     if (!domDocument.setContent(device, true, &errorStr, &errorLine,
                                 &errorColumn)) {
-        QMessageBox::information(window(), tr("XML Editor"),
-                                 tr("Parse error at line %1, column %2:\n%3")
-                                 .arg(errorLine)
-                                 .arg(errorColumn)
-                                 .arg(errorStr));
+        readFail(tr("Parse error at line %1, column %2:\n%3")
+                 .arg(errorLine)
+                 .arg(errorColumn)
+                 .arg(errorStr));
         return false;
     }
 
-    QDomElement root = domDocument.documentElement();
-    QStack<ParseState> stack;
-    ParseState current = ParseState().clone(root);
+    if (!parseDocument())
+        return false;
+    if (readOnly) {
+        releaseDocument();
+    } else {
+        recordBaseline = recordsText();
+        saveBaseIndexing = QtConcurrent::run(&SaveBase::index, file);
+        indexingSaveBase = true;
+    }
+    return true;
+}
 
+// Viewer mode: keep the parsed data and let go of every handle into the DOM, then the DOM itself
+void XmlEdit::releaseDocument() {
+	metadata.clear();
+	QDomElement root = domDocument.documentElement();
+	for (QDomElement child = root.firstChildElement(); !child.isNull(); child = child.nextSiblingElement())
+		if (child.firstChildElement().isNull())
+			metadata[child.tagName()] = child.text();
+
+	auto release = [](SingleRun &run) {
+		for (SingleSplit &split : run.splits) {
+			split.keptValid = split.valid();
+			split.timeXml = split.realTimeXml = split.otherXml = QDomElement();
+			split.textXml = split.otherTextXml = QDomCharacterData();
+		}
+		run.realTimeTotal = run.otherTotal = QDomCharacterData();
+	};
+	release(bestRun);
+	release(bestSplits);
+	for (SingleRun &column : comparisons)
+		release(column);
+	for (SingleRun &run : runs)
+		release(run);
+	domDocument = QDomDocument();
+	released = true;
+	clearHistory();
+}
+
+QString XmlEdit::toplevelText(const QString &tag) const {
+	if (released)
+		return metadata.value(tag);
+	return domDocument.documentElement().firstChildElement(tag).text();
+}
+
+static const char *recordTags[] = {"SplitTimes", "BestSegmentTime"};
+#define RECORD_TAGS 2
+
+QStringList XmlEdit::recordsText() const {
+	QStringList records;
+	for (const QDomElement &segment : segmentElements(domDocument.documentElement().firstChildElement("Segments")))
+		for (int r = 0; r < RECORD_TAGS; r++)
+			records.append(segment.firstChildElement(recordTags[r]).text());
+	return records;
+}
+
+// Walk node and everything under it, starting in state current. Returns false if the parser
+// gave up, in which case it has already said why.
+bool XmlEdit::parseSubtree(QDomNode node, ParseState current) {
+    ParseState stack[PARSE_STACK_DEPTH]; // stack[d] is the state from before the node at depth d+1
+    int depth = 0;
+    QWidget *content = widget();
+
+    while (!node.isNull()) {
+    	// Save the state so siblings don't see this node's changes
+    	stack[depth++] = current;
+    	// Allow addNode to make any state changes appropriate for this node
+    	addNode(current, node, content, vLayout);
+    	// Do we need to bail out?
+    	if (current.dead)
+    		return false;
+    	// Children will see the state changes, but no one else will
+    	QDomNode next;
+    	if (depth < PARSE_STACK_DEPTH)
+    		next = node.firstChild();
+    	if (!next.isNull()) {
+    		node = next;
+    		continue;
+    	}
+    	// No children or children are finished, rewind and move to next node
+    	while (depth > 0) {
+    		current = stack[--depth];
+    		if (depth == 0) // Siblings of the starting node aren't ours to walk
+    			break;
+    		next = node.nextSibling();
+    		if (!next.isNull())
+    			break;
+    		node = node.parentNode();
+    	}
+    	node = next;
+    }
+    return true;
+}
+
+// Put segments scanned outside the DOM where addNode would have, by segment index
+void XmlEdit::mergeScannedSegments(const QVector<ScannedSegment> &segments) {
+	auto take = [this](SingleSplit &split, const ScannedTime &time) {
+		split.keptValid = true; // There's no element, but there would have been
+		split.method = timingMethod;
+		for (int method = 0; method < TIMING_METHOD_COUNT; method++) {
+			if (!time.has[method])
+				continue;
+			if (method != timingMethod) {
+				split.otherHas = true;
+				split.otherUs = time.us[method];
+			} else if (split.xmlIsTotal) {
+				split.totalHas = true;
+				split.totalUs = time.us[method];
+			} else {
+				split.splitHas = true;
+				split.splitUs = time.us[method];
+			}
+		}
+	};
+
+	for (int sidx = 0; sidx < segments.size(); sidx++) {
+		const ScannedSegment &segment = segments[sidx];
+		if (segment.hasName) {
+			while (splitNames.size() < sidx)
+				splitNames.append(QString());
+			splitNames.append(segment.name);
+		}
+		if (segment.hasBest) {
+			bestSplits.ensureSpaceFor(sidx);
+			take(bestSplits.splits[sidx], segment.best);
+		}
+		for (int cidx = 0; cidx < segment.comparisons.size(); cidx++) {
+			SingleRun &column = comparisonRun(comparisonIndex(segment.comparisonNames[cidx]));
+			column.ensureSpaceFor(sidx);
+			column.splits[sidx].xmlIsTotal = true;
+			take(column.splits[sidx], segment.comparisons[cidx]);
+		}
+		for (const ScannedTime &time : segment.history) {
+			SingleRun &run = runs[time.id];
+			run.id = time.id;
+			run.ensureSpaceFor(sidx);
+			take(run.splits[sidx], time);
+		}
+	}
+	topSegment = segments.size() - 1;
+}
+
+// Walk domDocument, filling in the run data and (if renderEnabled) the tables. Expects clearUi() state
+bool XmlEdit::parseDocument(const QVector<ScannedSegment> *segments) {
     QWidget *content = widget();
     QVBoxLayout *vContentLayout = vLayout;
     //vContentLayout->setContentsMargins(0,0,0,0);
 	//content->setLayout(vContentLayout);
 
     // Parse XML
-    while(1) {
-    	if (!current.node.isNull()) {
-    		// Push a copy of the state to the stack
-    		stack.push(current);
-    		// Allow addNode to make any state changes appropriate for this node
-    		addNode(current, stack.count(), content, vContentLayout);
-    		// Do we need to bail out?
-    		if (current.dead) {
-    			clearUi();
-    			return false;
-    		}
-    		// Children will see the state changes, but no one else will
-    		current = current.clone(current.node.firstChild());
-    	} else if (!stack.count()) {
-    		break;
-    	} else {
-    		// No children or children are finished, rewind and move to next node
-    		ParseState previous = stack.pop();
-    		current = previous.clone(previous.node.nextSibling());
-    	}
+    if (!parseSubtree(domDocument.documentElement(), {PARSING_ROOT, false, 0})) {
+    	clearUi();
+    	return false;
     }
+    if (segments)
+    	mergeScannedSegments(*segments);
+    if (shownComparison < 0) // Not in this file, so show it empty
+    	comparisonIndex(shownComparisonName);
+    padComparisons();
+    indexRuns();
+    emit comparisonsChanged();
+
+    if (!renderEnabled)
+    	return true;
 
     // Build tables
-    renderRun(QString(tr("Personal Best")), bestRun, content, vContentLayout);
+    renderRun(comparisonTitle(shownComparisonName), bestRun, content, vContentLayout);
     renderRun(QString(tr("Best Splits")), bestSplits, content, vContentLayout);
+    attemptLayout = new AttemptLayout;
+    vContentLayout->addLayout(attemptLayout);
     for(int ridx = 0; ridx < runKeys.size(); ridx++) {
     	int id = runKeys[ridx];
     	SingleRun &run = runs[id];
 
-    	renderRun(QString(tr("Run %1: %2")).arg(id).arg(run.timeLabel), run, content, vContentLayout);
+    	renderRun(QString(tr("Run %1: %2")).arg(id).arg(run.timeLabel), run, content, attemptLayout);
     }
 
     // Double-check tables
@@ -700,16 +1478,1470 @@ bool XmlEdit::read(QIODevice *device) {
     	SingleRun &run = runs[id];
     	correctTable(run, false, false); // Runs track split time
     }
+    applySort();
+    scheduleVisibleUpdate();
+    emit dataChanged();
 
     return true;
 }
 
+bool XmlEdit::readFile(const QString &fileName, QString *errorString) {
+    // Not opened as text, since it might be a compressed archive. The XML parser handles any newlines
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+
+    errorString->clear();
+    if (ArchiveReader::detect(&file)) { // Decompress straight into the parser
+        ArchiveReader archive(&file);
+        archive.open(QIODevice::ReadOnly);
+        if (!read(&archive)) { // Will print own message box, damage shows up as a parse error too
+            *errorString = archive.isCorrupt() ? archive.errorString() : readError;
+            return false;
+        }
+        return true;
+    }
+    if (!read(&file)) { // Will print own message box, unless rendering is off
+        *errorString = readError;
+        return false;
+    }
+    return true;
+}
+
+// Children of parent with tag and an id past lastId, in document order. The timer only
+// appends, so this looks backward from the end and stops at the first older id.
+static QVector<QDomElement> newerChildren(const QDomElement &parent, const QString &tag, qint64 lastId) {
+	QVector<QDomElement> found;
+	for (QDomElement child = parent.lastChildElement(tag); !child.isNull(); child = child.previousSiblingElement(tag)) {
+		bool success;
+		qint64 id = child.attribute("id").toLongLong(&success);
+		if (success && id <= lastId)
+			break;
+		if (success)
+			found.prepend(child);
+	}
+	return found;
+}
+
+// Bring in what the timer has added to fileName since it was loaded: attempts with ids past
+// the last one here and their times, which are the only parts parsed and rendered, so the
+// view and any edits to older attempts stay as they are. The file's PB and golds also replace
+// ours wherever they differ, except where ours have unsaved edits, which sets recordsKept. If
+// the segments themselves changed none of this can work, and structureChanged is set.
+int XmlEdit::ingestFile(const QString &fileName, bool *structureChanged, bool *recordsKept, QString *errorString) {
+	*structureChanged = released; // With no DOM to compare against, only a full reload will do
+	*recordsKept = false;
+	if (released)
+		return -1;
+	QFile file(fileName);
+	if (!file.open(QFile::ReadOnly)) {
+		*errorString = file.errorString();
+		return -1;
+	}
+	QDomDocument fresh;
+	QString parseError;
+	int errorLine, errorColumn;
+	bool parsed;
+	if (ArchiveReader::detect(&file)) {
+		ArchiveReader archive(&file);
+		archive.open(QIODevice::ReadOnly);
+		parsed = fresh.setContent(&archive, true, &parseError, &errorLine, &errorColumn);
+	} else {
+		parsed = fresh.setContent(&file, true, &parseError, &errorLine, &errorColumn);
+	}
+	if (!parsed) { // Likely the timer is still writing it
+		*errorString = tr("Parse error at line %1, column %2:\n%3").arg(errorLine).arg(errorColumn).arg(parseError);
+		return -1;
+	}
+
+	QDomElement root = domDocument.documentElement(), freshRoot = fresh.documentElement();
+	QDomElement history = root.firstChildElement("AttemptHistory"), freshHistory = freshRoot.firstChildElement("AttemptHistory");
+	QVector<QDomElement> segments = segmentElements(root.firstChildElement("Segments"));
+	QVector<QDomElement> freshSegments = segmentElements(freshRoot.firstChildElement("Segments"));
+	bool same = !history.isNull() && !freshHistory.isNull() && segments.size() == freshSegments.size();
+	for (int idx = 0; same && idx < segments.size(); idx++)
+		same = segments[idx].firstChildElement("Name").text() == freshSegments[idx].firstChildElement("Name").text();
+	if (!same) {
+		*structureChanged = true;
+		return -1;
+	}
+
+	qint64 lastId = 0;
+	for (qint64 id : runKeys)
+		lastId = qMax(lastId, id);
+	QVector<QDomElement> attempts = newerChildren(freshHistory, "Attempt", lastId);
+
+	// Parsing the copied nodes from the state their parents would have left puts them in
+	// runKeys and runs exactly as a full load would
+	int firstNew = runKeys.size();
+	bool ok = true;
+	saveWhole = true; // The new nodes aren't parts of the save base
+	for (const QDomElement &attempt : attempts)
+		ok = ok && parseSubtree(history.appendChild(domDocument.importNode(attempt, true)), {PARSING_ATTEMPT_SCAN, false, 0});
+
+	bool recordsChanged = false;
+	bool baselineKnown = recordBaseline.size() == segments.size() * RECORD_TAGS;
+	int comparisonCount = comparisonNames.size();
+	for (int idx = 0; ok && idx < segments.size(); idx++) {
+		topSegment = idx;
+		QDomElement times = segments[idx].firstChildElement("SegmentHistory");
+		if (times.isNull())
+			times = segments[idx].appendChild(domDocument.createElement("SegmentHistory")).toElement();
+		for (const QDomElement &time : newerChildren(freshSegments[idx].firstChildElement("SegmentHistory"), "Time", lastId))
+			ok = ok && parseSubtree(times.appendChild(domDocument.importNode(time, true)), {PARSING_SEGMENT_HISTORY, false, 0});
+
+		// Comparisons and gold, replaced whole and parsed again, keeping the table cells they show in.
+		// Unless they have unsaved edits, which win over the timer's
+		for (int r = 0; ok && r < RECORD_TAGS; r++) {
+			QDomElement mine = segments[idx].firstChildElement(recordTags[r]);
+			QDomElement theirs = freshSegments[idx].firstChildElement(recordTags[r]);
+			if (theirs.isNull() || (!mine.isNull() && mine.text() == theirs.text()))
+				continue;
+			if (modified && (!baselineKnown || mine.text() != recordBaseline[idx * RECORD_TAGS + r])) {
+				*recordsKept = true;
+				continue;
+			}
+			if (baselineKnown)
+				recordBaseline[idx * RECORD_TAGS + r] = theirs.text();
+			QDomNode replacement = domDocument.importNode(theirs, true);
+			if (mine.isNull())
+				segments[idx].appendChild(replacement);
+			else
+				segments[idx].replaceChild(replacement, mine);
+			QVector<SingleRun *> records;
+			if (r == 0) {
+				for (int index = 0; index < comparisons.size(); index++)
+					records.append(&comparisonRun(index));
+			} else {
+				records.append(&bestSplits);
+			}
+			for (SingleRun *record : records) {
+				record->ensureSpaceFor(idx);
+				SingleSplit &split = record->splits[idx];
+				QTableWidgetItem *splitTimeWidget = split.splitTimeWidget, *totalTimeWidget = split.totalTimeWidget;
+				split = SingleSplit();
+				split.splitTimeWidget = splitTimeWidget;
+				split.totalTimeWidget = totalTimeWidget;
+			}
+			ok = parseSubtree(replacement, {PARSING_SEGMENT, false, 0});
+			recordsChanged = true;
+		}
+	}
+	if (!ok) { // The parser has explained. Only a full reload can make sense of this now
+		*structureChanged = true;
+		return -1;
+	}
+	padComparisons();
+	if (comparisonNames.size() != comparisonCount)
+		emit comparisonsChanged();
+
+	QDomCharacterData attemptCount = root.firstChildElement("AttemptCount").firstChild().toCharacterData();
+	QString freshCount = freshRoot.firstChildElement("AttemptCount").text();
+	if (standaloneEdits.contains(TAG_ATTEMPT_COUNT))
+		standaloneEdits[TAG_ATTEMPT_COUNT]->setText(freshCount); // Its watcher updates the DOM
+	else if (!attemptCount.isNull())
+		attemptCount.setData(freshCount);
+
+	indexRuns();
+	if (recordsChanged) // Undoing would put back records that are no longer the file's
+		clearHistory();
+	if (renderEnabled) {
+		if (recordsChanged) {
+			refreshRun(bestRun, true);
+			refreshRun(bestSplits, false);
+			invalidateAllDeltas();
+		}
+		for (int ridx = firstNew; ridx < runKeys.size(); ridx++) {
+			SingleRun &run = runs[runKeys[ridx]];
+			renderRun(QString(tr("Run %1: %2")).arg(run.id).arg(run.timeLabel), run, widget(), attemptLayout);
+			correctTable(run, false, false);
+			if (!runOrder.isEmpty()) // Laid out at the bottom for now
+				runOrder.append(run.id);
+		}
+		if (runKeys.size() > firstNew)
+			applySort();
+		scheduleVisibleUpdate();
+	}
+
+	if (modified) // The journal is against the old file, which is gone
+		journal.stop();
+	emit dataChanged();
+	return runKeys.size() - firstNew;
+}
+
+// Add imported attempts to <AttemptHistory> and each <Segment>'s <SegmentHistory>.
+// Every container is looked up once up front, then all the new nodes go in in one pass.
+int XmlEdit::appendAttempts(const QVector<ImportedAttempt> &attempts, QString *errorString) {
+	QDomElement root = domDocument.documentElement();
+	QDomElement history = root.firstChildElement("AttemptHistory");
+	QDomElement segments = root.firstChildElement("Segments");
+	if (history.isNull() || segments.isNull()) {
+		*errorString = tr("This file has no <AttemptHistory> or <Segments> to add attempts to");
+		return -1;
+	}
+
+	QVector<QDomElement> segmentHistories;
+	for (QDomElement segment = segments.firstChildElement("Segment"); !segment.isNull(); segment = segment.nextSiblingElement("Segment")) {
+		QDomElement segmentHistory = segment.firstChildElement("SegmentHistory");
+		if (segmentHistory.isNull())
+			segmentHistory = segment.appendChild(domDocument.createElement("SegmentHistory")).toElement();
+		segmentHistories.append(segmentHistory);
+	}
+
+	// New attempts come after every existing one, and after every id the segment histories use,
+	// so none of them picks up times left behind by an attempt that's gone
+	qint64 nextId = 1;
+	for (auto it = runs.constBegin(); it != runs.constEnd(); ++it)
+		nextId = qMax(nextId, it.key() + 1);
+
+	for (const ImportedAttempt &attempt : attempts) {
+		if (attempt.splits.size() > segmentHistories.size()) {
+			*errorString = tr("An attempt has more splits than this file has segments");
+			return -1; // parseImport should have caught this, before anything was changed
+		}
+	}
+
+	for (const ImportedAttempt &attempt : attempts) {
+		QString id = QString::number(nextId++);
+		QDomElement attemptXml = domDocument.createElement("Attempt");
+		attemptXml.setAttribute("id", id);
+		attemptXml.setAttribute("started", attempt.started);
+
+		uint64_t totalUs = 0;
+		for (int sidx = 0; sidx < attempt.splits.size(); sidx++) {
+			const ImportedSplit &split = attempt.splits[sidx];
+			QDomElement timeXml = domDocument.createElement("Time");
+			timeXml.setAttribute("id", id);
+			if (split.has) { // Skipped splits are an empty <Time>
+				QDomElement realTimeXml = domDocument.createElement(timingTag(timingMethod));
+				realTimeXml.appendChild(domDocument.createTextNode(usToStr(split.us)));
+				timeXml.appendChild(realTimeXml);
+				totalUs += split.us;
+			}
+			segmentHistories[sidx].appendChild(timeXml);
+		}
+
+		// Only a run that reached the last split has a final time
+		if (!attempt.splits.isEmpty() && attempt.splits.size() == segmentHistories.size() && attempt.splits.constLast().has) {
+			QDomElement realTimeXml = domDocument.createElement(timingTag(timingMethod));
+			realTimeXml.appendChild(domDocument.createTextNode(usToStr(totalUs)));
+			attemptXml.appendChild(realTimeXml);
+		}
+		history.appendChild(attemptXml);
+	}
+
+	// LiveSplit counts every attempt ever started
+	QDomElement attemptCount = root.firstChildElement("AttemptCount");
+	if (!attemptCount.isNull()) {
+		QDomCharacterData text = attemptCount.firstChild().toCharacterData();
+		bool success;
+		qint64 count = text.data().toLongLong(&success);
+		if (!text.isNull() && success)
+			text.setData(QString::number(count + attempts.size()));
+	}
+
+	journal.stop(); // The saved file doesn't have these attempts, so edits to them can't be replayed
+	clearHistory();
+	rebuild();
+	setModified(true);
+	return attempts.size();
+}
+
+// (us + shiftUs) * scalePpm / 1000000 into result, or false if that goes below zero or doesn't fit
+// in 64 bits. Whole millions and the remainder are scaled apart, so nothing overflows on the way
+static bool transformUs(uint64_t us, const TimeTransform &transform, uint64_t *result) {
+	uint64_t shift = transform.shiftUs < 0 ? quint64(0) - quint64(transform.shiftUs) : quint64(transform.shiftUs);
+	if (transform.shiftUs < 0 ? us < shift : us > ULLONG_MAX - shift)
+		return false;
+	uint64_t shifted = transform.shiftUs < 0 ? us - shift : us + shift;
+	uint64_t whole = shifted / 1000000, rest = shifted % 1000000;
+	if (transform.scalePpm > ULLONG_MAX / 1000000 || (transform.scalePpm && whole > ULLONG_MAX / transform.scalePpm))
+		return false;
+	uint64_t scaled = whole * transform.scalePpm, restScaled = rest * transform.scalePpm / 1000000;
+	if (scaled > ULLONG_MAX - restScaled)
+		return false;
+	*result = scaled + restScaled;
+	return true;
+}
+
+// Apply transform to the split times of every attempt (and the records, if asked) in one pass
+// per run and timing method: change the split array, rebuild the totals with one running sum,
+// write the DOM. Nothing changes unless every run can take the transform. The tables are
+// updated at the end with repainting held off, rather than run by run.
+qint64 XmlEdit::transformTimes(const TimeTransform &transform, QString *errorString) {
+	QVector<SingleRun *> targets;
+	int totalColumns = 0; // targets before this are comparisons, which the file keeps as totals
+	targets.reserve(runKeys.size() + comparisons.size() + 2);
+	if (transform.includeRecords) {
+		targets = comparisonColumns();
+		totalColumns = targets.size();
+		targets.append(&bestSplits);
+	}
+	for (qint64 id : runKeys)
+		targets.append(&runs[id]);
+
+	int first = transform.segment < 0 ? 0 : transform.segment;
+	int last = transform.segment < 0 ? INT_MAX : transform.segment; // Inclusive
+
+	// Each pass puts the other timing method in the shown one's fields, so the method not shown
+	// goes first and the shown one's derived splits and totals are what's left at the end
+	auto swapMethods = [&targets, totalColumns]() {
+		for (SingleRun *run : targets)
+			swapRunTimingMethod(*run);
+		for (int tidx = 0; tidx < totalColumns; tidx++) // Their split times may never have been worked out
+			splitsFromTotals(*targets[tidx]);
+	};
+
+	// Check first, so a bad transform leaves everything alone
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) {
+		swapMethods();
+		for (SingleRun *run : targets) {
+			int end = qMin(run->splits.size() - 1, last);
+			for (int sidx = first; sidx <= end; sidx++) {
+				const SingleSplit &split = run->splits[sidx];
+				uint64_t us;
+				if (!split.splitHas || transformUs(split.splitUs, transform, &us))
+					continue;
+				bool tooShort = transform.shiftUs < 0 && split.splitUs < quint64(0) - quint64(transform.shiftUs);
+				*errorString = (tooShort ? tr("The %1 split of %2 is only %3 in %4") : tr("The %1 split of %2 is %3 in %4, too long to change that much"))
+					.arg(sidx < splitNames.size() ? splitNames[sidx] : QString::number(sidx + 1))
+					.arg(run == &bestRun ? tr("the Personal Best") : run == &bestSplits ? tr("the Best Splits")
+						: targets.indexOf(run) < totalColumns ? tr("a comparison") : tr("run %1").arg(run->id))
+					.arg(usToStr(split.splitUs))
+					.arg(split.method == TIMING_GAME ? tr("game time") : tr("real time"));
+				if (pass == 0)
+					swapMethods();
+				return -1;
+			}
+		}
+	}
+
+	qint64 changed = 0;
+	bool undoable = true; // Undo only knows the cells of the shown method and comparison
+	QVector<UndoEdit> group; // Each cell as the XML has it: splits, or totals for the PB
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) {
+		bool shown = pass == TIMING_METHOD_COUNT - 1;
+		swapMethods();
+		for (int tidx = 0; tidx < targets.size(); tidx++) {
+			SingleRun *run = targets[tidx];
+			bool onScreen = tidx >= totalColumns || run == &bestRun; // Other comparisons have no table
+			bool recorded = shown && onScreen; // Undo can put it back
+			QVector<SingleSplit> &splits = run->splits;
+			int end = qMin(splits.size() - 1, last);
+			for (int sidx = first; sidx <= end; sidx++) {
+				SingleSplit &split = splits[sidx];
+				if (!split.splitHas)
+					continue;
+				uint64_t oldUs = split.splitUs;
+				transformUs(oldUs, transform, &split.splitUs); // Can't fail, that was checked
+				if (recorded && !split.xmlIsTotal && split.valid())
+					group.append({run->id, sidx, 1, UNDO_OLD_PRESENT | UNDO_NEW_PRESENT, oldUs, split.splitUs});
+				undoable = undoable && recorded;
+				if (shown)
+					changed++;
+			}
+			if (first >= splits.size())
+				continue;
+
+			// Totals before the first changed split come out the same, but only later ones are written
+			RunningTotal total;
+			for (int sidx = 0; sidx < splits.size(); sidx++) {
+				SingleSplit &split = splits[sidx];
+				bool oldHas = split.totalHas;
+				uint64_t oldUs = split.totalUs;
+				split.totalHas = total.add(split);
+				split.totalUs = total.us;
+				if (split.valid() && sidx >= first && (sidx <= last || split.xmlIsTotal))
+					split.write(domDocument);
+				if (recorded && split.xmlIsTotal && split.valid() && sidx >= first && (oldHas != split.totalHas || (oldHas && oldUs != split.totalUs)))
+					group.append({run->id, sidx, 2, quint8((oldHas ? UNDO_OLD_PRESENT : 0) | (split.totalHas ? UNDO_NEW_PRESENT : 0)),
+						oldHas ? oldUs : 0, split.totalHas ? split.totalUs : 0});
+			}
+			if (onScreen && run != &bestSplits && !splits.isEmpty() && splits.constLast().totalHas)
+				setFinalTotal(*run, true, splits.constLast().totalUs);
+		}
+	}
+
+	if (renderEnabled) {
+		widget()->setUpdatesEnabled(false);
+		for (SingleRun *run : targets)
+			showSplits(*run);
+		widget()->setUpdatesEnabled(true);
+		invalidateAllDeltas();
+	}
+
+	journal.stop(); // Replayed cell edits would land on untransformed times
+	if (undoable)
+		pushHistory(group);
+	else
+		clearHistory();
+	setModified(true);
+	return changed;
+}
+
+// Set the text of segment's child element tag, creating it if needed
+static void setChildText(QDomDocument domDocument, QDomElement segment, const QString &tag, const QString &text) {
+	QDomElement child = segment.firstChildElement(tag);
+	if (child.isNull())
+		child = segment.insertBefore(domDocument.createElement(tag), QDomNode()).toElement();
+	else if (child.text() == text)
+		return;
+	while (!child.firstChild().isNull())
+		child.removeChild(child.firstChild());
+	child.appendChild(domDocument.createTextNode(text));
+}
+
+// A <Segment> with no times, laid out the way LiveSplit writes one. It gets an empty
+// <SplitTime> for each comparison the template segment has.
+static QDomElement newSegmentXml(QDomDocument domDocument, const QDomElement &templateSegment) {
+	QDomElement segment = domDocument.createElement("Segment");
+	segment.appendChild(domDocument.createElement("Name"));
+	segment.appendChild(domDocument.createElement("Icon"));
+	QDomElement splitTimes = segment.appendChild(domDocument.createElement("SplitTimes")).toElement();
+	QDomElement templateTimes = templateSegment.firstChildElement("SplitTimes");
+	for (QDomElement time = templateTimes.firstChildElement("SplitTime"); !time.isNull(); time = time.nextSiblingElement("SplitTime"))
+		splitTimes.appendChild(domDocument.createElement("SplitTime")).toElement().setAttribute("name", time.attribute("name"));
+	if (splitTimes.firstChildElement("SplitTime").isNull())
+		splitTimes.appendChild(domDocument.createElement("SplitTime")).toElement().setAttribute("name", "Personal Best");
+	segment.appendChild(domDocument.createElement("BestSegmentTime"));
+	segment.appendChild(domDocument.createElement("SegmentHistory"));
+	return segment;
+}
+
+// Rearrange <Segments> to match layout. Each <Segment> carries its own history, best
+// segment and PB time, so moving the elements moves those; the rest is one pass over the
+// runs through the old->new index mapping. Every comparison is stored as totals and gets
+// rewritten, final times are summed again in case a segment was deleted (all of these in
+// both timing methods), and a run left with a hole before its last split gets a skipped
+// <Time> there so it isn't "missing" splits.
+bool XmlEdit::remapSegments(const SegmentLayout &layout, QString *errorString) {
+	QDomElement segmentsXml = domDocument.documentElement().firstChildElement("Segments");
+	if (segmentsXml.isNull()) {
+		*errorString = tr("This file has no <Segments>");
+		return false;
+	}
+	QVector<QDomElement> oldSegments = segmentElements(segmentsXml);
+
+	int count = layout.source.size();
+	if (count == 0) {
+		*errorString = tr("There must be at least one segment");
+		return false;
+	}
+	QVector<bool> used(oldSegments.size(), false);
+	bool valid = layout.names.size() == count;
+	for (int source : layout.source) {
+		valid = valid && source < oldSegments.size() && (source < 0 || !used[source]);
+		if (valid && source >= 0)
+			used[source] = true;
+	}
+	if (!valid) {
+		*errorString = tr("The new segment list doesn't match the file");
+		return false;
+	}
+
+	// New segment elements in their new order
+	QVector<QDomElement> newSegments(count), histories(count);
+	QDomElement templateSegment = oldSegments.isEmpty() ? QDomElement() : oldSegments[0];
+	for (int idx = 0; idx < count; idx++) {
+		int source = layout.source[idx];
+		QDomElement segment = source >= 0 ? oldSegments[source] : newSegmentXml(domDocument, templateSegment);
+		setChildText(domDocument, segment, "Name", layout.names[idx]);
+		QDomElement history = segment.firstChildElement("SegmentHistory");
+		if (history.isNull())
+			history = segment.appendChild(domDocument.createElement("SegmentHistory")).toElement();
+		newSegments[idx] = segment;
+		histories[idx] = history;
+	}
+	for (QDomElement &segment : oldSegments) // Deleted ones stay out
+		segmentsXml.removeChild(segment);
+	for (QDomElement &segment : newSegments)
+		segmentsXml.appendChild(segment);
+
+	// Comparisons are kept as totals, which will change, but their splits won't. Work those out
+	// for each timing method before anything moves
+	QStringList columnNames;
+	QVector<SingleRun *> columns = comparisonColumns(&columnNames);
+	QVector<QVector<SingleSplit>> columnSplits; // [pass * columns.size() + cidx], in the old order
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) { // The method not shown, then back
+		for (SingleRun *column : columns) {
+			swapRunTimingMethod(*column);
+			splitsFromTotals(*column);
+			columnSplits.append(column->splits);
+		}
+	}
+
+	auto remap = [&layout, count](SingleRun &run) {
+		QVector<SingleSplit> splits(count);
+		for (int idx = 0; idx < count; idx++) {
+			int source = layout.source[idx];
+			if (source >= 0 && source < run.splits.size())
+				splits[idx] = run.splits[source];
+		}
+		while (!splits.isEmpty() && !splits.constLast().valid()) // A reset run stays short
+			splits.removeLast();
+		run.splits.swap(splits);
+	};
+
+	for (SingleRun &run : runs) {
+		remap(run);
+		for (int idx = 0; idx < run.splits.size(); idx++) {
+			SingleSplit &split = run.splits[idx];
+			if (!split.valid()) { // Hole, fill it with a skip
+				QDomElement time = domDocument.createElement("Time");
+				time.setAttribute("id", QString::number(run.id));
+				split = SingleSplit();
+				split.timeXml = histories[idx].appendChild(time).toElement();
+				split.method = timingMethod;
+			}
+		}
+		for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) { // Final times, for each timing method
+			swapRunTimingMethod(run);
+			RunningTotal total;
+			for (const SingleSplit &split : run.splits)
+				total.add(split);
+			if (!run.realTimeTotal.isNull() && run.splits.size() == count && run.splits.constLast().splitHas)
+				run.realTimeTotal.setData(usToStr(total.us));
+		}
+	}
+
+	for (int cidx = 0; cidx < columns.size(); cidx++) {
+		SingleRun &column = *columns[cidx];
+		remap(column);
+		for (int idx = 0; idx < count; idx++) {
+			if (layout.source[idx] >= 0)
+				continue;
+			column.ensureSpaceFor(idx);
+			QDomElement time = newSegments[idx].firstChildElement("SplitTimes").firstChildElement("SplitTime");
+			while (!time.isNull() && time.attribute("name") != columnNames[cidx])
+				time = time.nextSiblingElement("SplitTime");
+			column.splits[idx].timeXml = time;
+			column.splits[idx].xmlIsTotal = true;
+			column.splits[idx].method = timingMethod;
+		}
+	}
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) {
+		for (int cidx = 0; cidx < columns.size(); cidx++) {
+			SingleRun &column = *columns[cidx];
+			const QVector<SingleSplit> &old = columnSplits[pass * columns.size() + cidx];
+			swapRunTimingMethod(column);
+			RunningTotal total;
+			for (int idx = 0; idx < column.splits.size(); idx++) {
+				SingleSplit &split = column.splits[idx];
+				int source = layout.source[idx];
+				split.splitHas = source >= 0 && source < old.size() && old[source].splitHas;
+				split.splitUs = split.splitHas ? old[source].splitUs : 0;
+				split.totalHas = total.add(split);
+				split.totalUs = total.us;
+				if (split.valid())
+					split.write(domDocument);
+			}
+		}
+	}
+
+	finishStructuralEdit();
+	return true;
+}
+
+// Combine segment first with the one after it, in one pass over the runs for each timing
+// method. The second <Segment> is kept, since its end is the split that remains, so its PB
+// total and every final time are already right; each attempt's time for it gets the first
+// one's added, and the first <Segment> goes. A run that skipped the second split skipped the
+// merged one too, and its time for the first goes on to its next recorded split, which was
+// timed from the end of the first. The merged gold is the best merged time in the history.
+bool XmlEdit::mergeSegments(int first, const QString &name, QString *errorString) {
+	QVector<QDomElement> segments = segmentElements(domDocument.documentElement().firstChildElement("Segments"));
+	int second = first + 1;
+	if (first < 0 || second >= segments.size()) {
+		*errorString = tr("There is no next segment to merge with");
+		return false;
+	}
+
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) { // The method not shown, then back to the shown one
+		for (SingleRun &run : runs)
+			swapRunTimingMethod(run);
+		swapRunTimingMethod(bestSplits);
+
+		bool goldHas = false;
+		uint64_t goldUs = 0;
+		for (SingleRun &run : runs) {
+			if (run.splits.size() <= second)
+				continue; // Reset before the end of the merged segment, its first <Time> goes with the <Segment>
+			SingleSplit &a = run.splits[first], &b = run.splits[second];
+			if (!b.valid() || !a.splitHas)
+				continue; // Otherwise b already covers both, and maybe more, so it's no gold
+			if (b.splitHas) {
+				b.splitUs += a.splitUs;
+				b.write(domDocument);
+				if (!goldHas || b.splitUs < goldUs)
+					goldUs = b.splitUs;
+				goldHas = true;
+				continue;
+			}
+			for (int sidx = second + 1; sidx < run.splits.size() && run.splits[sidx].valid(); sidx++) {
+				SingleSplit &next = run.splits[sidx];
+				if (next.splitHas) {
+					next.splitUs += a.splitUs;
+					next.write(domDocument);
+					break;
+				}
+			}
+		}
+
+		// No history to go by, so the best that can be said is the sum of the two golds
+		if (!goldHas && bestSplits.splits.size() > second && bestSplits.splits[first].splitHas && bestSplits.splits[second].splitHas) {
+			goldUs = bestSplits.splits[first].splitUs + bestSplits.splits[second].splitUs;
+			goldHas = true;
+		}
+		if (bestSplits.splits.size() > second && bestSplits.splits[second].valid()) {
+			SingleSplit &gold = bestSplits.splits[second];
+			gold.splitHas = goldHas;
+			gold.splitUs = goldUs;
+			gold.write(domDocument);
+		}
+	}
+
+	setChildText(domDocument, segments[second], "Name", name);
+	segments[first].parentNode().removeChild(segments[first]);
+
+	finishStructuralEdit();
+	return true;
+}
+
+// Divide segment index in two, in one pass over the runs. The existing <Segment> becomes the
+// second part, keeping its end and so every comparison's total and every final time; a new one
+// named firstName goes before it. Each attempt's time is divided by firstUs for that attempt if
+// given, otherwise by firstPpm, and a skipped time is skipped in both parts. Golds for the
+// parts are the best in the history.
+bool XmlEdit::splitSegment(int index, const QString &firstName, quint64 firstPpm, const QHash<qint64, uint64_t> &firstUs, QString *errorString) {
+	QVector<QDomElement> segments = segmentElements(domDocument.documentElement().firstChildElement("Segments"));
+	if (index < 0 || index >= segments.size() || firstPpm > 1000000) {
+		*errorString = tr("There is no such segment to split");
+		return false;
+	}
+	for (auto found = firstUs.constBegin(); found != firstUs.constEnd(); ++found) {
+		const SingleRun *run = runForId(found.key());
+		if (!run || run->splits.size() <= index || !run->splits[index].splitHas || run->splits[index].splitUs < found.value()) {
+			*errorString = tr("Run %1 has no time for that segment as long as %2").arg(found.key()).arg(usToStr(found.value()));
+			return false;
+		}
+	}
+
+	QDomElement part = newSegmentXml(domDocument, segments[index]);
+	setChildText(domDocument, part, "Name", firstName);
+	segments[index].parentNode().insertBefore(part, segments[index]);
+	QDomElement history = part.firstChildElement("SegmentHistory");
+
+	// Both timing methods are divided. The one not shown goes by the same fraction as the shown
+	// one for each attempt, or by firstPpm where the shown one has no time
+	TimingMethod otherMethod = timingMethod == TIMING_GAME ? TIMING_REAL : TIMING_GAME;
+	bool goldHas[TIMING_METHOD_COUNT][2] = {}; // [method][part]
+	uint64_t goldUs[TIMING_METHOD_COUNT][2] = {};
+	auto candidate = [&goldHas, &goldUs](TimingMethod method, const uint64_t parts[2]) {
+		for (int p = 0; p < 2; p++) {
+			if (!goldHas[method][p] || parts[p] < goldUs[method][p])
+				goldUs[method][p] = parts[p];
+			goldHas[method][p] = true;
+		}
+	};
+	for (SingleRun &run : runs) {
+		if (run.splits.size() <= index || !run.splits[index].valid())
+			continue;
+		SingleSplit &split = run.splits[index];
+		QDomElement time = history.appendChild(domDocument.createElement("Time")).toElement();
+		time.setAttribute("id", QString::number(run.id));
+
+		quint64 runPpm = firstPpm;
+		if (split.splitHas) {
+			auto found = firstUs.constFind(run.id);
+			uint64_t parts[2];
+			parts[0] = found != firstUs.constEnd() ? found.value() : split.splitUs * firstPpm / 1000000;
+			parts[1] = split.splitUs - parts[0];
+			if (split.splitUs)
+				runPpm = parts[0] * 1000000 / split.splitUs;
+			QDomElement realTimeXml;
+			QDomCharacterData textXml;
+			writeXml(domDocument, parts[0], true, time, realTimeXml, textXml, timingMethod);
+			split.splitUs = parts[1];
+			split.write(domDocument);
+			candidate(timingMethod, parts);
+		}
+		if (split.otherHas) {
+			uint64_t parts[2];
+			parts[0] = split.otherUs * runPpm / 1000000;
+			parts[1] = split.otherUs - parts[0];
+			QDomElement otherXml;
+			QDomCharacterData otherTextXml;
+			writeXml(domDocument, parts[0], true, time, otherXml, otherTextXml, otherMethod);
+			split.otherUs = parts[1];
+			writeXml(domDocument, split.otherUs, true, split.timeXml, split.otherXml, split.otherTextXml, otherMethod);
+			candidate(otherMethod, parts);
+		}
+	}
+
+	if (bestSplits.splits.size() > index && bestSplits.splits[index].valid()) {
+		SingleSplit &gold = bestSplits.splits[index];
+		for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) { // The method not shown, then back
+			swapRunTimingMethod(bestSplits);
+			TimingMethod method = gold.method;
+			if (!goldHas[method][0] && gold.splitHas) { // No history, divide the old gold the same way
+				goldUs[method][0] = gold.splitUs * firstPpm / 1000000;
+				goldUs[method][1] = gold.splitUs - goldUs[method][0];
+				goldHas[method][0] = goldHas[method][1] = true;
+			}
+			QDomElement realTimeXml = part.firstChildElement("BestSegmentTime").firstChildElement(timingTag(method));
+			QDomCharacterData textXml = realTimeXml.firstChild().toCharacterData();
+			writeXml(domDocument, goldUs[method][0], goldHas[method][0], part.firstChildElement("BestSegmentTime"), realTimeXml, textXml, method);
+			gold.splitHas = goldHas[method][1];
+			gold.splitUs = goldUs[method][1];
+			gold.write(domDocument);
+		}
+	}
+
+	// Each comparison's total for the first part is wherever its time for the segment divides
+	QStringList columnNames;
+	QVector<SingleRun *> columns = comparisonColumns(&columnNames);
+	for (int pass = 0; pass < TIMING_METHOD_COUNT; pass++) {
+		for (int cidx = 0; cidx < columns.size(); cidx++) {
+			SingleRun &column = *columns[cidx];
+			swapRunTimingMethod(column);
+			splitsFromTotals(column);
+			if (column.splits.size() <= index || !column.splits[index].splitHas)
+				continue;
+			const SingleSplit &split = column.splits[index];
+			uint64_t totalUs = split.totalUs - split.splitUs + split.splitUs * firstPpm / 1000000;
+			QDomElement time = part.firstChildElement("SplitTimes").firstChildElement("SplitTime");
+			while (!time.isNull() && time.attribute("name") != columnNames[cidx])
+				time = time.nextSiblingElement("SplitTime");
+			QDomElement realTimeXml = time.firstChildElement(timingTag(split.method));
+			QDomCharacterData textXml = realTimeXml.firstChild().toCharacterData();
+			writeXml(domDocument, totalUs, true, time, realTimeXml, textXml, split.method);
+		}
+	}
+
+	finishStructuralEdit();
+	return true;
+}
+
+// Copy a run's split and total times into its table as they are, without correcting anything
+void XmlEdit::showSplits(SingleRun &run) {
+	correctingTable = true;
+	for (SingleSplit &split : run.splits) {
+		if (!split.valid()) // Shows "-----"
+			continue;
+		if (split.splitTimeWidget)
+			split.splitTimeWidget->setText(split.splitHas ? usToStr(split.splitUs) : QString());
+		if (split.totalTimeWidget)
+			split.totalTimeWidget->setText(split.totalHas ? usToStr(split.totalUs) : QString());
+	}
+	correctingTable = false;
+}
+
+// Rows first..last of run have new times. Mark the delta cells that depend on them stale:
+// the run's own, or for a record, that column in every run
+void XmlEdit::invalidateDeltas(SingleRun &run, int first, int last) {
+	quint8 bits = run.id == RUN_ID_PERSONAL_BEST ? DELTA_BIT(COLUMN_DELTA_PB)
+		: run.id == RUN_ID_BEST_SPLITS ? DELTA_BIT(COLUMN_DELTA_GOLD) : DELTA_BITS_ALL;
+	auto invalidate = [first, last, bits](SingleRun &target) {
+		for (int row = qMax(first, 0); row <= last && row < target.splits.size(); row++)
+			target.splits[row].deltaFresh &= ~bits;
+	};
+	if (bits == DELTA_BITS_ALL) {
+		invalidate(run);
+	} else {
+		for (SingleRun &target : runs)
+			invalidate(target);
+	}
+	scheduleVisibleUpdate();
+}
+
+// After changes to everything at once, such as switching timing method
+void XmlEdit::invalidateAllDeltas() {
+	deltaEpoch++;
+	scheduleVisibleUpdate();
+}
+
+// Scrolling and edits come in bursts, so the delta cells are brought up to date once afterward
+void XmlEdit::scheduleVisibleUpdate() {
+	if ((!deltaColumns && !lazyTableLimit) || visibleUpdatePending)
+		return;
+	visibleUpdatePending = true;
+	QTimer::singleShot(0, this, &XmlEdit::updateVisibleRuns);
+}
+
+static QString signedUsToStr(uint64_t us, uint64_t reference) {
+	return us >= reference ? "+" + usToStr(us - reference) : "-" + usToStr(reference - us);
+}
+
+// Fill in whichever of row's delta cells are stale
+void XmlEdit::fillDeltas(SingleRun &run, int row) {
+	SingleSplit &split = run.splits[row];
+	if (split.deltaEpoch != deltaEpoch) {
+		split.deltaEpoch = deltaEpoch;
+		split.deltaFresh = 0;
+	}
+	if (split.deltaFresh == DELTA_BITS_ALL)
+		return;
+
+	for (int column = COLUMN_DELTA_PB; column <= COLUMN_DELTA_GOLD; column++) {
+		if (split.deltaFresh & DELTA_BIT(column))
+			continue;
+		const SingleRun &record = column == COLUMN_DELTA_PB ? bestRun : bestSplits;
+		const SingleSplit *reference = row < record.splits.size() ? &record.splits[row] : NULL;
+		QString text;
+		if (column == COLUMN_DELTA_PB && split.valid() && split.totalHas && reference && reference->valid() && reference->totalHas)
+			text = signedUsToStr(split.totalUs, reference->totalUs);
+		else if (column == COLUMN_DELTA_GOLD && split.valid() && split.splitHas && reference && reference->valid() && reference->splitHas)
+			text = signedUsToStr(split.splitUs, reference->splitUs);
+
+		QTableWidgetItem *item = run.tableWidget->item(row, column);
+		if (!item) {
+			item = new QTableWidgetItem();
+			item->setFont(monoFont);
+			item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+			item->setTextAlignment(Qt::AlignRight|Qt::AlignVCenter);
+			run.tableWidget->setItem(row, column, item);
+		}
+		item->setText(text);
+	}
+	split.deltaFresh = DELTA_BITS_ALL;
+}
+
+// Build the lazy tables that have come on screen, bring the delta cells of every row on screen
+// up to date, and then drop the tables that have been off screen longest
+void XmlEdit::updateVisibleRuns() {
+	visibleUpdatePending = false;
+	if ((!deltaColumns && !lazyTableLimit) || !renderEnabled || runKeys.isEmpty())
+		return;
+	int top = verticalScrollBar()->value(), bottom = top + viewport()->height();
+	auto place = [this](SingleRun &run) -> QWidget * { // Where the run is laid out, table or not
+		return run.tableWidget ? static_cast<QWidget *>(run.tableWidget) : run.placeholderWidget ? run.placeholderWidget
+			: run.titleWidget ? run.titleWidget->parentWidget() : NULL;
+	};
+
+	// Runs are laid out in order, so look for the first one on screen by bisection
+	const QVector<qint64> &order = shownAttemptIds();
+	int low = 0, high = order.size();
+	while (low < high) {
+		int middle = (low + high) / 2;
+		QWidget *widget = place(attemptRun(order[middle]));
+		if (widget && widget->geometry().bottom() < top)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	visiblePass++;
+	correctingTable = true;
+	for (int ridx = low; ridx < order.size(); ridx++) {
+		SingleRun &run = attemptRun(order[ridx]);
+		QWidget *widget = place(run);
+		if (widget && widget->y() > bottom)
+			break;
+		run.shownAt = visiblePass;
+		buildLazyTable(run);
+		if (!run.tableWidget || !deltaColumns)
+			continue;
+		QTableWidget *table = run.tableWidget;
+		int offset = table->y() + table->horizontalHeader()->height();
+		int first = top <= offset ? 0 : table->rowAt(top - offset);
+		int last = table->rowAt(bottom - offset);
+		if (first < 0)
+			continue;
+		if (last < 0)
+			last = table->rowCount() - 1;
+		for (int row = first; row <= last; row++)
+			fillDeltas(run, row);
+	}
+	correctingTable = false;
+	dropColdTables();
+}
+
+// Height renderTable gives a table, so a placeholder takes the same room
+int XmlEdit::tableHeight(int rows) {
+	if (!tableRowHeight) {
+		TableWidgetNoScroll probe(1, RUN_TABLE_COLUMNS);
+		probe.setHorizontalHeaderLabels(runTableLabels);
+		tableHeaderHeight = probe.horizontalHeader()->height() + probe.horizontalHeader()->offset();
+		tableRowHeight = probe.rowHeight(0);
+	}
+	return tableHeaderHeight + rows * tableRowHeight;
+}
+
+// Build a lazy run's table in its placeholder's place. Does nothing if it's built already
+void XmlEdit::buildLazyTable(SingleRun &run) {
+	if (!run.placeholderWidget)
+		return;
+	QTableWidget *table = renderTable(run, widget());
+	table->setGeometry(run.placeholderWidget->geometry()); // Where the layout will put it anyway
+	delete attemptLayout->replace(run.placeholderWidget, table);
+	delete run.placeholderWidget;
+	run.placeholderWidget = NULL;
+	for (SingleSplit &split : run.splits)
+		split.deltaFresh = 0; // The new table has no delta cells yet
+	builtIds.append(run.id);
+}
+
+// Throw away a run's table, items and all, leaving a placeholder. Its times are all in run.splits
+void XmlEdit::dropLazyTable(SingleRun &run) {
+	QWidget *placeholder = new QWidget(widget());
+	placeholder->setFixedHeight(run.tableWidget->height());
+	delete attemptLayout->replace(run.tableWidget, placeholder);
+	delete run.tableWidget;
+	run.tableWidget = NULL;
+	run.placeholderWidget = placeholder;
+	for (SingleSplit &split : run.splits)
+		split.splitTimeWidget = split.totalTimeWidget = NULL;
+}
+
+// Drop the tables seen longest ago until no more than lazyTableLimit are built. Tables on screen
+// or being typed in stay, even if that's over the limit
+void XmlEdit::dropColdTables() {
+	if (!lazyTableLimit || builtIds.size() <= lazyTableLimit)
+		return;
+	std::sort(builtIds.begin(), builtIds.end(), [this](qint64 a, qint64 b) {
+		return attemptRun(a).shownAt < attemptRun(b).shownAt;
+	});
+	QWidget *focus = QApplication::focusWidget();
+	int kept = 0, excess = builtIds.size() - lazyTableLimit;
+	for (int idx = 0; idx < builtIds.size(); idx++) {
+		SingleRun &run = attemptRun(builtIds[idx]);
+		if (!run.tableWidget) {
+			excess--;
+			continue;
+		}
+		if (excess <= 0 || run.shownAt == visiblePass
+			|| (focus && (focus == run.tableWidget || run.tableWidget->isAncestorOf(focus)))) {
+			builtIds[kept++] = builtIds[idx];
+			continue;
+		}
+		dropLazyTable(run);
+		excess--;
+	}
+	builtIds.resize(kept);
+}
+
+// Show or hide the delta columns on every attempt's table. Nothing is worked out until it's on screen
+void XmlEdit::setDeltaColumns(bool shown) {
+	if (shown == deltaColumns)
+		return;
+	deltaColumns = shown;
+	for (SingleRun &run : runs) {
+		if (!run.tableWidget)
+			continue;
+		run.tableWidget->setColumnHidden(COLUMN_DELTA_PB, !shown);
+		run.tableWidget->setColumnHidden(COLUMN_DELTA_GOLD, !shown);
+	}
+	scheduleVisibleUpdate();
+}
+
+// run's place when sorting by sortKey, smallest first. ridx is its index in runKeys.
+// Runs with nothing to sort by come last whichever way the sort goes.
+quint64 XmlEdit::sortValue(const SingleRun &run, int ridx) const {
+	bool has = false;
+	quint64 value = 0;
+	switch (sortKey) {
+		case SORT_FILE:
+			has = true;
+			value = ridx;
+			break;
+		case SORT_FINAL_TIME:
+		case SORT_SEGMENT_TIME: {
+			int sidx = sortKey == SORT_FINAL_TIME ? splitNames.size() - 1 : sortSegment;
+			if (sidx >= 0 && sidx < run.splits.size()) {
+				const SingleSplit &split = run.splits[sidx];
+				has = split.valid() && split.totalHas;
+				value = split.totalUs;
+			}
+		} break;
+		case SORT_STARTED: { // LiveSplit writes "started" as US-style local time
+			QDateTime started = QDateTime::fromString(run.timeLabel, "MM/dd/yyyy HH:mm:ss");
+			has = started.isValid() && started.toMSecsSinceEpoch() >= 0;
+			value = started.toMSecsSinceEpoch();
+		} break;
+		case SORT_SEGMENTS_COMPLETED:
+			has = true;
+			for (int sidx = run.splits.size() - 1; sidx >= 0 && !value; sidx--)
+				if (run.splits[sidx].splitHas)
+					value = sidx + 1;
+			break;
+	}
+	if (!has)
+		return ULLONG_MAX;
+	return sortDescending ? ULLONG_MAX - 1 - value : value;
+}
+
+// Lay the attempts out again in sortKey order. Nothing is parsed or rendered: each key is worked
+// out once, the keys are sorted, and attemptLayout puts the runs' existing widgets in that order.
+void XmlEdit::applySort() {
+	if (!renderEnabled || !attemptLayout || runKeys.isEmpty())
+		return;
+
+	QVector<qint64> order;
+	if (sortKey != SORT_FILE || sortDescending) {
+		QVector<QPair<quint64, int>> keys; // Ties stay in file order, since ridx is part of the key
+		keys.reserve(runKeys.size());
+		for (int ridx = 0; ridx < runKeys.size(); ridx++)
+			keys.append(qMakePair(sortValue(attemptRun(runKeys[ridx]), ridx), ridx));
+		std::sort(keys.begin(), keys.end());
+		order.reserve(keys.size());
+		for (const QPair<quint64, int> &key : keys)
+			order.append(runKeys[key.second]);
+	}
+	const QVector<qint64> &laidOut = shownAttemptIds();
+	if ((order.isEmpty() ? runKeys : order) == laidOut)
+		return;
+
+	QVector<QWidget *> widgets;
+	widgets.reserve(runKeys.size() * 3);
+	for (qint64 id : order.isEmpty() ? runKeys : order) {
+		SingleRun &run = attemptRun(id);
+		widgets.append(run.ruleWidget);
+		widgets.append(run.titleWidget->parentWidget());
+		if (run.tableWidget)
+			widgets.append(run.tableWidget);
+		else if (run.placeholderWidget)
+			widgets.append(run.placeholderWidget);
+	}
+	attemptLayout->permute(widgets); // One layout pass, however many attempts moved
+	runOrder = order;
+	scheduleVisibleUpdate();
+}
+
+// Show attempts in a new order. Quick enough to call on every click, see applySort
+void XmlEdit::sortAttempts(RunSortKey key, int segment, bool descending) {
+	sortKey = key;
+	sortSegment = segment;
+	sortDescending = descending;
+	applySort();
+}
+
+void XmlEdit::showAttempt(qint64 id) {
+	auto found = runs.find(id);
+	if (found == runs.end() || !found->ruleWidget)
+		return;
+	buildLazyTable(*found);
+	verticalScrollBar()->setValue(found->ruleWidget->y());
+	if (found->tableWidget)
+		found->tableWidget->setFocus();
+}
+
+#define REPAIR_NEIGHBORS 25 // Complete runs looked at on each side of a run being repaired
+
+// Log of each segment's median split time over the complete runs nearest to row (an index
+// into runKeys) on either side, or NAN where there's nothing to go by. Logs, because being
+// off by a factor matters equally for long and short segments.
+static QVector<double> neighborReference(const QVector<const SingleRun *> &complete, const QVector<int> &completeRows, int row, int count) {
+	int middle = std::lower_bound(completeRows.begin(), completeRows.end(), row) - completeRows.begin();
+	int begin = qMax(0, middle - REPAIR_NEIGHBORS), end = qMin(complete.size(), middle + REPAIR_NEIGHBORS);
+	QVector<double> reference(count, NAN);
+	QVector<uint64_t> times;
+	for (int sidx = 0; sidx < count; sidx++) {
+		times.clear();
+		for (int cidx = begin; cidx < end; cidx++)
+			times.append(complete[cidx]->splits[sidx].splitUs);
+		if (times.isEmpty())
+			continue;
+		std::nth_element(times.begin(), times.begin() + times.size()/2, times.end());
+		reference[sidx] = std::log(double(times[times.size()/2]) + 1);
+	}
+	return reference;
+}
+
+static double alignCost(double item, double reference) {
+	if (std::isnan(item) || std::isnan(reference)) // Skipped, or nothing to compare to
+		return 0;
+	return (item - reference) * (item - reference);
+}
+
+// Best order-keeping placement of a run's recorded splits (log times, NAN if skipped) among
+// the segments, by how far each lands from the reference. Fills slots and returns the cost.
+static double alignSplits(const QVector<double> &items, const QVector<double> &reference, QVector<int> &slots) {
+	int count = reference.size(), k = items.size();
+	// cost[i*count + j] is the cheapest way to place items 0..i with item i in segment j
+	QVector<double> cost(k * count, INFINITY);
+	QVector<int> back(k * count, -1);
+	for (int j = 0; j < count; j++)
+		cost[j] = alignCost(items[0], reference[j]);
+	for (int i = 1; i < k; i++) {
+		double best = INFINITY;
+		int bestJ = -1;
+		for (int j = 1; j < count; j++) {
+			if (cost[(i-1)*count + j-1] < best) {
+				best = cost[(i-1)*count + j-1];
+				bestJ = j-1;
+			}
+			cost[i*count + j] = best + alignCost(items[i], reference[j]);
+			back[i*count + j] = bestJ;
+		}
+	}
+	int j = std::min_element(cost.begin() + (k-1)*count, cost.end()) - (cost.begin() + (k-1)*count);
+	double total = cost[(k-1)*count + j];
+	slots.resize(k);
+	for (int i = k-1; i >= 0; i--) {
+		slots[i] = j;
+		j = back[i*count + j];
+	}
+	return total;
+}
+
+// Look for attempts with "missing" splits before their last one, and finished attempts that
+// are missing splits at the end. Missing splits in the middle become skips, which keeps the
+// totals; but if the run's times fit the neighboring runs much better in other segments, as
+// happens when segments were reordered after it was recorded, they move there first. Missing
+// splits at the end share out whatever of the final time the recorded splits don't cover,
+// in proportion to the neighboring runs.
+QVector<RunRepair> XmlEdit::findRepairs() const {
+	int count = splitNames.size();
+	QVector<RunRepair> repairs;
+	if (!count)
+		return repairs;
+
+	QVector<const SingleRun *> complete;
+	QVector<int> completeRows;
+	for (int row = 0; row < runKeys.size(); row++) {
+		const SingleRun &run = runs.constFind(runKeys[row]).value(); // Every key has a run
+		bool isComplete = run.splits.size() == count;
+		for (const SingleSplit &split : run.splits)
+			isComplete = isComplete && split.valid() && split.splitHas;
+		if (isComplete) {
+			complete.append(&run);
+			completeRows.append(row);
+		}
+	}
+
+	for (int row = 0; row < runKeys.size(); row++) {
+		const SingleRun &run = runs.constFind(runKeys[row]).value();
+		QVector<double> items;
+		QVector<int> current;
+		uint64_t recordedUs = 0;
+		for (int sidx = 0; sidx < run.splits.size() && sidx < count; sidx++) {
+			const SingleSplit &split = run.splits[sidx];
+			if (!split.valid())
+				continue;
+			items.append(split.splitHas ? std::log(double(split.splitUs) + 1) : NAN);
+			current.append(sidx);
+			if (split.splitHas)
+				recordedUs += split.splitUs;
+		}
+		bool finalHas = false;
+		uint64_t finalUs = run.realTimeTotal.isNull() ? 0 : strToUs(run.realTimeTotal.data(), &finalHas);
+		bool holes = !current.isEmpty() && current.size() != current.constLast() + 1;
+		bool truncated = finalHas && finalUs > recordedUs && (current.isEmpty() || current.constLast() < count - 1);
+		if (!holes && !truncated)
+			continue;
+
+		QVector<double> reference = neighborReference(complete, completeRows, row, count);
+		QVector<int> slots = current;
+		bool moved = false;
+		if (holes) {
+			double currentCost = 0;
+			for (int i = 0; i < items.size(); i++)
+				currentCost += alignCost(items[i], reference[current[i]]);
+			QVector<int> best;
+			double bestCost = alignSplits(items, reference, best);
+			if (bestCost + 0.5 < currentCost && bestCost < currentCost / 2) { // Clearly better, not just noise
+				slots = best;
+				moved = true;
+			}
+		}
+
+		RunRepair repair;
+		repair.runId = run.id;
+		int last = slots.isEmpty() ? -1 : slots.constLast();
+		int fill = truncated ? count : last + 1;
+		repair.splits.fill({-1, false, 0}, fill);
+		int skips = 0;
+		for (int i = 0; i < slots.size(); i++) {
+			const SingleSplit &split = run.splits[current[i]];
+			repair.splits[slots[i]] = {current[i], split.splitHas, split.splitHas ? split.splitUs : 0};
+		}
+		for (int sidx = 0; sidx <= last; sidx++)
+			if (repair.splits[sidx].from < 0)
+				skips++;
+
+		QStringList changes;
+		if (moved)
+			changes += tr("moves its times to the segments where they match neighboring runs");
+		if (skips)
+			changes += tr("marks %n missing split(s) as skipped", "", skips);
+		if (truncated && last < count - 1) { // Moving the times may have reached the last segment already
+			// Share the rest of the final time by the neighbors' medians, or evenly without them
+			QVector<double> weights;
+			double weightSum = 0;
+			for (int sidx = last + 1; sidx < count; sidx++) {
+				weights.append(std::isnan(reference[sidx]) ? 1 : std::exp(reference[sidx]));
+				weightSum += weights.constLast();
+			}
+			uint64_t restUs = finalUs - recordedUs, sharedUs = 0;
+			for (int sidx = last + 1; sidx < count; sidx++) {
+				uint64_t us = sidx == count - 1 ? restUs - sharedUs : uint64_t(restUs * weights[sidx - last - 1] / weightSum);
+				sharedUs += us;
+				repair.splits[sidx] = {-1, true, us};
+			}
+			changes += tr("fills in the last %n split(s) from its final time of %1", "", count - last - 1).arg(usToStr(finalUs));
+		}
+		repair.description = tr("Run %1 (%2): %3").arg(run.id).arg(run.timeLabel).arg(changes.join(tr(", ")));
+		repairs.append(repair);
+	}
+	return repairs;
+}
+
+// Carry out repairs from findRepairs. Existing <Time>s are moved between segments rather
+// than recreated, so anything else LiveSplit keeps in them survives, the timing method not
+// shown included.
+bool XmlEdit::applyRepairs(const QVector<RunRepair> &repairs, QString *errorString) {
+	QVector<QDomElement> segments = segmentElements(domDocument.documentElement().firstChildElement("Segments"));
+	for (const RunRepair &repair : repairs) {
+		auto found = runs.constFind(repair.runId);
+		bool valid = found != runs.constEnd() && repair.splits.size() <= segments.size();
+		for (const RepairSplit &split : repair.splits)
+			valid = valid && split.from < found.value().splits.size() && (split.from < 0 || found.value().splits[split.from].valid());
+		if (!valid) {
+			*errorString = tr("The repairs don't match the file any more");
+			return false;
+		}
+	}
+
+	QVector<QDomElement> histories;
+	for (QDomElement &segment : segments) {
+		QDomElement history = segment.firstChildElement("SegmentHistory");
+		if (history.isNull())
+			history = segment.appendChild(domDocument.createElement("SegmentHistory")).toElement();
+		histories.append(history);
+	}
+
+	TimingMethod otherMethod = timingMethod == TIMING_GAME ? TIMING_REAL : TIMING_GAME;
+	for (const RunRepair &repair : repairs) {
+		SingleRun &run = runs[repair.runId];
+		QVector<SingleSplit> old = run.splits;
+
+		// Moved <Time>s take the other timing method's time along. Filled-in splits share out
+		// what's left of its final time the same way as the shown method's
+		bool otherFinalHas = false;
+		uint64_t otherFinalUs = run.otherTotal.isNull() ? 0 : strToUs(run.otherTotal.data(), &otherFinalHas);
+		uint64_t otherRestUs = otherFinalUs, filledUs = 0;
+		int lastFilled = -1;
+		for (int sidx = 0; sidx < repair.splits.size(); sidx++) {
+			const RepairSplit &change = repair.splits[sidx];
+			if (change.from >= 0 && old[change.from].otherHas)
+				otherRestUs = otherRestUs > old[change.from].otherUs ? otherRestUs - old[change.from].otherUs : 0;
+			else if (change.from < 0 && change.has) {
+				filledUs += change.us;
+				lastFilled = sidx;
+			}
+		}
+		uint64_t otherSharedUs = 0, filledSoFarUs = 0;
+
+		for (int sidx = 0; sidx < repair.splits.size(); sidx++) {
+			const RepairSplit &change = repair.splits[sidx];
+			SingleSplit split = change.from >= 0 ? old[change.from] : SingleSplit();
+			if (change.from < 0) {
+				split.timeXml = domDocument.createElement("Time");
+				split.timeXml.setAttribute("id", QString::number(run.id));
+			}
+			if (change.from != sidx)
+				histories[sidx].appendChild(split.timeXml);
+			split.xmlIsTotal = false;
+			split.method = timingMethod;
+			split.splitHas = change.has;
+			split.splitUs = change.us;
+			split.write(domDocument);
+			if (change.from < 0 && change.has && otherFinalHas && filledUs) {
+				filledSoFarUs += change.us;
+				uint64_t us = sidx == lastFilled ? otherRestUs - otherSharedUs
+					: uint64_t(double(otherRestUs) * filledSoFarUs / filledUs) - otherSharedUs;
+				otherSharedUs += us;
+				writeXml(domDocument, us, true, split.timeXml, split.otherXml, split.otherTextXml, otherMethod);
+			}
+		}
+	}
+
+	finishStructuralEdit();
+	return true;
+}
+
+#define SAVE_INDENT 4 // As write() saves
+#define SEGMENT_HISTORY_TIME_DEPTH 4 // <Run><Segments><Segment><SegmentHistory><Time>
+
+// True if element has a time for either timing method
+static bool hasAnyTime(const QDomElement &element) {
+	return !element.firstChildElement("RealTime").isNull() || !element.firstChildElement("GameTime").isNull();
+}
+
+// About how many bytes element takes in a saved file, indentation included
+static qint64 savedSize(const QDomElement &element, int depth) {
+	QString text;
+	QTextStream stream(&text);
+	element.save(stream, SAVE_INDENT);
+	stream.flush();
+	return text.toUtf8().size() + qint64(text.count('\n')) * depth * SAVE_INDENT;
+}
+
+// Find the <SegmentHistory> entries that tell LiveSplit nothing, and if elements isn't null, the
+// <Time> element for each. One pass over <AttemptHistory> for which attempts exist and finished,
+// then one over each <SegmentHistory>. Segments go last to first, so an empty entry can be
+// told from a skipped split by whether its attempt has a time in a later segment, and each
+// history goes back to front, so the entry kept of any duplicates is the last, as the parser reads.
+QVector<HistoryGarbage> XmlEdit::sweepHistory(QVector<QDomElement> *elements) const {
+	QVector<HistoryGarbage> garbage;
+	QDomElement root = domDocument.documentElement();
+	QHash<qint64, bool> finished; // By attempt id
+	for (QDomElement attempt = root.firstChildElement("AttemptHistory").firstChildElement("Attempt"); !attempt.isNull(); attempt = attempt.nextSiblingElement("Attempt")) {
+		bool success;
+		qint64 id = attempt.attribute("id").toLongLong(&success);
+		if (success)
+			finished[id] = hasAnyTime(attempt);
+	}
+
+	QVector<QDomElement> segments = segmentElements(root.firstChildElement("Segments"));
+	QSet<qint64> timedLater;
+	for (int sidx = segments.size() - 1; sidx >= 0; sidx--) {
+		QString segmentName = sidx < splitNames.size() ? splitNames[sidx] : tr("Segment %1").arg(sidx + 1);
+		QSet<qint64> seen;
+		QVector<qint64> timedHere;
+		QDomElement history = segments[sidx].firstChildElement("SegmentHistory");
+		for (QDomElement time = history.lastChildElement("Time"); !time.isNull(); time = time.previousSiblingElement("Time")) {
+			bool success;
+			qint64 id = time.attribute("id").toLongLong(&success);
+			if (!success)
+				continue;
+			bool timed = hasAnyTime(time);
+			auto attempt = finished.constFind(id);
+			HistoryGarbage entry = {sidx, id, GARBAGE_ORPHAN, 0, QString()};
+			if (id > 0 && attempt == finished.constEnd()) {
+				entry.description = tr("%1: time from attempt %2, which isn't in the attempt history").arg(segmentName).arg(id);
+			} else if (seen.contains(id)) {
+				entry.kind = GARBAGE_DUPLICATE;
+				entry.description = tr("%1: extra time for attempt %2").arg(segmentName).arg(id);
+			} else if (!timed && attempt != finished.constEnd() && !attempt.value() && !timedLater.contains(id)) {
+				entry.kind = GARBAGE_RESET;
+				entry.description = tr("%1: empty time from attempt %2, after it was reset").arg(segmentName).arg(id);
+			} else {
+				seen.insert(id);
+				if (timed)
+					timedHere.append(id);
+				continue;
+			}
+			entry.bytes = savedSize(time, SEGMENT_HISTORY_TIME_DEPTH);
+			garbage.append(entry);
+			if (elements)
+				elements->append(time);
+		}
+		for (qint64 id : timedHere)
+			timedLater.insert(id);
+	}
+	return garbage;
+}
+
+qint64 XmlEdit::collectGarbage(QString *errorString) {
+	if (released) {
+		*errorString = tr("The file is open read-only");
+		return -1;
+	}
+	QVector<QDomElement> elements;
+	QVector<HistoryGarbage> garbage = sweepHistory(&elements);
+	if (garbage.isEmpty())
+		return 0;
+	qint64 bytes = 0;
+	for (int idx = 0; idx < garbage.size(); idx++) {
+		bytes += garbage[idx].bytes;
+		elements[idx].parentNode().removeChild(elements[idx]);
+	}
+
+	finishStructuralEdit();
+	return bytes;
+}
+
+// Renumber the attempts 1..N in order of start time, and put <AttemptHistory> and every
+// <SegmentHistory> in that order, which is the order the timer appends in. Everything is checked
+// and gathered in one pass, then one remap table from old id to new rewrites every id.
+bool XmlEdit::compactIds(QString *errorString) {
+	if (released) {
+		*errorString = tr("The file is open read-only");
+		return false;
+	}
+	QDomElement root = domDocument.documentElement();
+	QDomElement attemptHistory = root.firstChildElement("AttemptHistory");
+
+	struct Attempt { qint64 started; qint64 id; QDomElement element; };
+	QVector<Attempt> attempts;
+	qint64 lastStarted = LLONG_MIN; // Attempts with no usable date stay after the one before them
+	QSet<qint64> ids;
+	for (QDomElement element = attemptHistory.firstChildElement("Attempt"); !element.isNull(); element = element.nextSiblingElement("Attempt")) {
+		bool success;
+		qint64 id = element.attribute("id").toLongLong(&success);
+		if (!success || ids.contains(id)) {
+			*errorString = tr("There's more than one attempt %1, or an attempt without an id").arg(element.attribute("id"));
+			return false;
+		}
+		ids.insert(id);
+		QDateTime started = QDateTime::fromString(element.attribute("started"), "MM/dd/yyyy HH:mm:ss");
+		if (started.isValid())
+			lastStarted = started.toMSecsSinceEpoch();
+		attempts.append({lastStarted, id, element});
+	}
+	std::stable_sort(attempts.begin(), attempts.end(), [](const Attempt &a, const Attempt &b) {
+		return a.started < b.started || (a.started == b.started && a.id < b.id);
+	});
+	QHash<qint64, qint64> remap;
+	remap.reserve(attempts.size());
+	for (int idx = 0; idx < attempts.size(); idx++)
+		remap[attempts[idx].id] = idx + 1;
+
+	// A time from an attempt that's gone would be taken for whichever attempt gets its id.
+	// Ids of 0 and below aren't attempts, so they stay as they are, at the start
+	QVector<QDomElement> segments = segmentElements(root.firstChildElement("Segments"));
+	QVector<QVector<QPair<qint64, QDomElement>>> times(segments.size()); // New id and <Time>, by segment
+	for (int sidx = 0; sidx < segments.size(); sidx++) {
+		QDomElement history = segments[sidx].firstChildElement("SegmentHistory");
+		for (QDomElement time = history.firstChildElement("Time"); !time.isNull(); time = time.nextSiblingElement("Time")) {
+			bool success;
+			qint64 id = time.attribute("id").toLongLong(&success);
+			if (!success)
+				id = 0;
+			if (id > 0) {
+				auto found = remap.constFind(id);
+				if (found == remap.constEnd()) {
+					*errorString = tr("Segment %1 has a time from attempt %2, which isn't in the attempt history. \"Clean Up History...\" removes these")
+						.arg(sidx + 1).arg(id);
+					return false;
+				}
+				id = found.value();
+			}
+			times[sidx].append(qMakePair(id, time));
+		}
+	}
+
+	// Moving an element to the end in turn leaves them all in order
+	for (int idx = 0; idx < attempts.size(); idx++) {
+		attempts[idx].element.setAttribute("id", qlonglong(idx + 1));
+		attemptHistory.appendChild(attempts[idx].element);
+	}
+	for (int sidx = 0; sidx < segments.size(); sidx++) {
+		QVector<QPair<qint64, QDomElement>> &entries = times[sidx];
+		std::stable_sort(entries.begin(), entries.end(), [](const QPair<qint64, QDomElement> &a, const QPair<qint64, QDomElement> &b) {
+			return a.first < b.first;
+		});
+		QDomElement history = segments[sidx].firstChildElement("SegmentHistory");
+		for (QPair<qint64, QDomElement> &entry : entries) {
+			if (entry.first > 0)
+				entry.second.setAttribute("id", qlonglong(entry.first));
+			history.appendChild(entry.second);
+		}
+	}
+
+	finishStructuralEdit();
+	return true;
+}
+
 // If truthIsTotal convert total->split otherwise do the opposite
 // If changeFinalTotal then it's okay to muck with realTimeTotal
 void XmlEdit::correctTable(SingleRun &run, bool truthIsTotal, bool changeFinalTotal) {
 	correctingTable = true; // Create a block in time we don't trigger ::changed
 
-	if (run.tableWidget) {
+	if (run.tableWidget || run.placeholderWidget) { // A lazy run's times still need correcting without a table
 		if (truthIsTotal) { // Total is truth, fill out splits
 			uint64_t lastUs = 0;
 	    	for(int sidx = 0; sidx < run.splits.size(); sidx++) {
@@ -730,7 +2962,7 @@ void XmlEdit::correctTable(SingleRun &run, bool truthIsTotal, bool changeFinalTo
 	    			split.splitHas = false;
 	    		}
     			if (!split.xmlIsTotal) // Write changes to xml DOM
-    				split.write(domDocument);
+    				writeSplit(split);
 	    	}
 		} else { // Splits are truth, fill out totals
 			uint64_t totalUs = 0;
@@ -752,15 +2984,11 @@ void XmlEdit::correctTable(SingleRun &run, bool truthIsTotal, bool changeFinalTo
 	    			split.totalHas = false;
 	    		}
     			if (split.xmlIsTotal) // Write changes to xml DOM
-    				split.write(domDocument);
+    				writeSplit(split);
 	    	}
 	    	// Handle the final "run total", which is tracked separately
-	    	if (changeFinalTotal && run.splits.size() == runTableLabels.size()) {
-	    		if (!run.realTimeTotal.isNull())
-		    		run.realTimeTotal.setData(usToStr(totalUs));
-	    		if (run.realTimeTotalWidget)
-		    		run.realTimeTotalWidget->setText(REALTIME_TOTAL_STR(usToStr(totalUs)));
-	    	}
+	    	if (changeFinalTotal)
+	    		setFinalTotal(run, true, totalUs);
 	    }
 	}
 
@@ -775,9 +3003,156 @@ bool XmlEdit::write(QIODevice *device) const {
     return true;
 }
 
+// Write split's time to the DOM, and note its part of the file for the next save
+void XmlEdit::writeSplit(SingleSplit &split) {
+	split.write(domDocument);
+	touchSaved(split.timeXml);
+}
+
+// Note that the part of the file holding node was edited, for snapshot(). The parts are the
+// ones SaveBase::index finds, and anything else has the next save serialize the document
+void XmlEdit::touchSaved(const QDomNode &node) {
+	if (saveWhole)
+		return;
+	QVarLengthArray<QDomElement, 8> path; // node's element and those it's in, up to the root
+	QDomNode at = node;
+	for (; !at.isNull() && !at.isDocument(); at = at.parentNode())
+		if (at.isElement())
+			path.append(at.toElement());
+	int depth = path.size();
+	auto id = [](const QDomElement &element, bool *ok) { return quint32(element.attribute("id").toLongLong(ok)); };
+
+	QDomElement part;
+	quint64 key = 0;
+	bool ok = true;
+	if (at.isNull() || depth < 2) {
+		// Not in the document, or the root itself
+	} else if (path[depth - 2].tagName() == "Segments") {
+		if (depth >= 4 && path[depth - 3].tagName() == "Segment") {
+			int segment = 0;
+			for (QDomElement before = path[depth - 3].previousSiblingElement("Segment"); !before.isNull(); before = before.previousSiblingElement("Segment"))
+				segment++;
+			if (path[depth - 4].tagName() != "SegmentHistory") {
+				part = path[depth - 4];
+				key = savePartKey(SAVE_PART_SEGMENT, segment, qHash(part.tagName()));
+			} else if (depth >= 5 && path[depth - 5].tagName() == "Time") {
+				part = path[depth - 5];
+				key = savePartKey(SAVE_PART_TIME, segment, id(part, &ok));
+			}
+		}
+	} else if (path[depth - 2].tagName() == "AttemptHistory") {
+		if (depth >= 3 && path[depth - 3].tagName() == "Attempt") {
+			part = path[depth - 3];
+			key = savePartKey(SAVE_PART_ATTEMPT, 0, id(part, &ok));
+		}
+	} else {
+		part = path[depth - 2];
+		key = savePartKey(SAVE_PART_TOPLEVEL, 0, qHash(part.tagName()));
+	}
+	if (part.isNull() || !ok)
+		saveWhole = true;
+	else
+		savePending.insert(key, part);
+}
+
+// A save only serializes the parts edited since saveBase, and patches them into it on the saver.
+// It copies the whole document instead if an edit was outside every part or stopped the journal
+// by moving things around, or if saveBase isn't indexed yet or has no place for a part
+SaveSnapshot XmlEdit::snapshot() {
+	if (indexingSaveBase && saveBaseIndexing.isFinished()) {
+		saveBase = saveBaseIndexing.result();
+		saveBaseIndexing = QFuture<SaveBase>();
+		indexingSaveBase = false;
+	}
+
+	SaveSnapshot snapshot;
+	bool whole = saveWhole || journal.isStopped() || !saveBase.valid;
+	for (auto pending = savePending.constBegin(); !whole && pending != savePending.constEnd(); ++pending) {
+		const SavePart *part = saveBase.find(pending.key());
+		if (!part) {
+			whole = true;
+			break;
+		}
+		QString text;
+		QTextStream out(&text);
+		pending.value().save(out, -1);
+		out.flush();
+		snapshot.patches.append({part->start, part->end, text.toUtf8()});
+	}
+	if (whole) {
+		// QDomDocument copies are shallow, so clone the nodes
+		snapshot.patches.clear();
+		snapshot.document = domDocument.cloneNode(true).toDocument();
+	} else {
+		std::sort(snapshot.patches.begin(), snapshot.patches.end(), [](const SavePatch &a, const SavePatch &b) {
+			return a.start < b.start;
+		});
+		snapshot.base = saveBase;
+	}
+	saveInFlight = savePending;
+	savePending.clear();
+	saveInFlightWhole = saveWhole;
+	saveWhole = false;
+	return snapshot;
+}
+
+// After a save of snapshot(), what it wrote is the base for the next one. Otherwise its parts
+// still need saving
+void XmlEdit::finishSnapshot(bool saved, const SaveBase &base) {
+	if (saved && base.valid) {
+		saveBase = base;
+	} else if (saved) { // A whole document, indexed on a worker like a file that was read
+		saveBase = SaveBase();
+		saveBaseIndexing = QtConcurrent::run(&SaveBase::index, base.bytes);
+		indexingSaveBase = true;
+	} else {
+		for (auto part = saveInFlight.constBegin(); part != saveInFlight.constEnd(); ++part)
+			if (!savePending.contains(part.key()))
+				savePending.insert(part.key(), part.value());
+		saveWhole = saveWhole || saveInFlightWhole;
+	}
+	saveInFlight.clear();
+	saveInFlightWhole = false;
+}
+
 
 void XmlEdit::clear() { // Also resets file state
 	domDocument.clear();
+	saveBase = SaveBase();
+	saveBaseIndexing = QFuture<SaveBase>(); // A worker still indexing finishes on its own
+	indexingSaveBase = false;
+	savePending.clear();
+	saveInFlight.clear();
+	saveWhole = saveInFlightWhole = false;
+	released = false;
+	metadata.clear();
+	recordBaseline.clear();
+	modified = false;
+	shownComparisonName = "Personal Best";
+	clearHistory();
+	journal.reset();
+	clearUi();
+	emit dataChanged();
+}
+
+// After an edit that moves or renumbers what the tables show: journaled and undoable cell edits
+// no longer line up with the saved file or the new rows, so both are dropped, and the views are
+// parsed again
+void XmlEdit::finishStructuralEdit() {
+	journal.stop();
+	clearHistory();
+	rebuild();
+	setModified(true);
+}
+
+// Throw away the views and parse them again from the DOM, after edits that change its structure
+void XmlEdit::rebuild() {
+	int scroll = verticalScrollBar()->value();
 	clearUi();
+	parseDocument();
+	// The new layout won't have a size until the event loop gets to it
+	QTimer::singleShot(0, this, [this, scroll]() {
+		verticalScrollBar()->setValue(scroll);
+	});
 }
 
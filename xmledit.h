@@ -9,6 +9,14 @@
 #include <QTableWidget>
 #include <QLabel>
 #include <QFont>
+#include <QFuture>
+#include "journal.h"
+#include "saver.h"
+#include "attemptlayout.h"
+
+struct ImportedAttempt;
+struct ScannedSegment;
+class QLineEdit;
 
 // Frustratingly, Qt has no abstract document class.
 // They have a text document class but it cannot be separated from its text model.
@@ -31,47 +39,164 @@ public Q_SLOTS:
     virtual void copy() = 0;
     virtual void paste() = 0;
 #endif
-    //virtual void undo() = 0;
-    //virtual void redo() = 0;
+    virtual void undo() = 0;
+    virtual void redo() = 0;
     virtual void clear() = 0; // Also resets file state
     virtual void clearUi(); // Also resets file state
 Q_SIGNALS:
 	void contentsChanged();
     void copyAvailable(bool b);
-    //void undoAvailable(bool);
-    //void redoAvailable(bool);
+    void undoAvailable(bool);
+    void redoAvailable(bool);
     //void undoCommandAdded();
 };
 
+// A table cell's new text, for edits applied in bulk
+struct CellEdit {
+    int row;
+    int column;
+    QString text;
+};
+
+// A change to many split times at once, e.g. after a game patch changed a load.
+// Each affected split time becomes (time + shiftUs) * scalePpm / 1000000.
+struct TimeTransform {
+    int segment = -1; // Segment index to change, or -1 for every segment
+    qint64 shiftUs = 0;
+    quint64 scalePpm = 1000000; // Parts per million, so 1000000 leaves times alone
+    bool includeRecords = true; // Also change the Personal Best, Best Splits and other comparisons
+};
+
+// A new list of segments, as made by the segment editor. source[i] is the old index of
+// new segment i, or -1 if it was inserted; old segments that don't appear are deleted.
+struct SegmentLayout {
+    QVector<int> source;
+    QStringList names;
+};
+
+// One split of a run as the repair pass would leave it
+struct RepairSplit {
+    int from; // Index of the run's existing <Time> that moves here, or -1 to create one
+    bool has; // False for a skipped split
+    uint64_t us;
+};
+
+// A change the repair pass proposes for one run: its new splits, in segment order
+struct RunRepair {
+    qint64 runId;
+    QString description;
+    QVector<RepairSplit> splits;
+};
+
+// Why a <Time> in a <SegmentHistory> tells LiveSplit nothing
+enum GarbageKind {
+    GARBAGE_ORPHAN, // Its attempt isn't in <AttemptHistory>. Ids of 0 and below never are, so they're kept
+    GARBAGE_DUPLICATE, // A later entry in the same history has its id, and that's the one read
+    GARBAGE_RESET // Empty, and its attempt was reset without a time in any later segment
+};
+
+// One entry the history clean up would remove
+struct HistoryGarbage {
+    int segment;
+    qint64 id;
+    GarbageKind kind;
+    qint64 bytes; // About what leaving it out saves in the saved file
+    QString description;
+};
+
+// LiveSplit times everything by the wall clock, and also by the game's own clock if the game
+// has load removal. Each split keeps both, so switching which one is shown doesn't reparse.
+enum TimingMethod {
+    TIMING_REAL, // <RealTime>
+    TIMING_GAME, // <GameTime>
+    TIMING_METHOD_COUNT
+};
+
+// Run table columns. The delta columns are optional and only on attempts' tables
+enum RunTableColumn {
+    COLUMN_NAME,
+    COLUMN_SPLIT,
+    COLUMN_TOTAL,
+    COLUMN_DELTA_PB, // Total minus the Personal Best's total
+    COLUMN_DELTA_GOLD, // Split minus the best split
+    RUN_TABLE_COLUMNS
+};
+// Orders the attempts can be shown in. Only the view changes; the file keeps its own order
+enum RunSortKey {
+    SORT_FILE, // <AttemptHistory> order, which is normally by attempt id
+    SORT_FINAL_TIME, // Unfinished runs go last
+    SORT_STARTED,
+    SORT_SEGMENT_TIME, // Total time at one segment, for runs that got there
+    SORT_SEGMENTS_COMPLETED
+};
+
+#define DELTA_BIT(column) (1 << ((column) - COLUMN_DELTA_PB)) // For SingleSplit::deltaFresh
+#define DELTA_BITS_ALL (DELTA_BIT(COLUMN_DELTA_PB) | DELTA_BIT(COLUMN_DELTA_GOLD))
+
 // Note: Us means microseconds, as in 1/1000 millisecond
+uint64_t strToUs(const QString &s, bool *success);
+QString usToStr(uint64_t us);
+
 struct SingleSplit {
     bool splitHas = false;
     uint64_t splitUs;
     bool totalHas = false;
     uint64_t totalUs;
     QDomElement timeXml; // <Time>, <SplitTime> or <BestSegmentTime>
-    QDomElement realTimeXml; // <RealTime>
-    QDomCharacterData textXml; // Text inside <RealTime>
+    QDomElement realTimeXml; // <RealTime> or <GameTime>, whichever timing method is shown
+    QDomCharacterData textXml; // Text inside realTimeXml
     bool xmlIsTotal = false; // otherwise split
+    TimingMethod method = TIMING_REAL; // Of realTimeXml, so write() knows what to create
+    // The timing method not shown, as it is in the XML (a total if xmlIsTotal)
+    bool otherHas = false;
+    uint64_t otherUs = 0;
+    QDomElement otherXml;
+    QDomCharacterData otherTextXml;
     QTableWidgetItem *splitTimeWidget = NULL;
     QTableWidgetItem *totalTimeWidget = NULL;
+    quint32 deltaEpoch = 0; // The XmlEdit deltaEpoch deltaFresh is from; any other means nothing is fresh
+    quint8 deltaFresh = 0; // DELTA_BITs of this row's delta cells that are up to date
+    bool keptValid = false; // What valid() was before the DOM was released, in viewer mode
     void write(QDomDocument domDocument);
-    bool valid() { return !timeXml.isNull(); }
+    void swapTimingMethod(); // Totals or splits, whichever isn't in the XML, are left to the caller
+    bool valid() const { return !timeXml.isNull() || keptValid; }
+};
+
+// Totals summed from splits the way correctTable does it. Once a "missing" split
+// has been passed, no later total means anything.
+struct RunningTotal {
+    uint64_t us = 0;
+    bool valid = true;
+    // Returns true if us is now a meaningful total for this split
+    bool add(const SingleSplit &split) {
+        valid = valid && split.valid();
+        if (split.splitHas)
+            us += split.splitUs;
+        return valid && split.splitHas;
+    }
 };
 
 struct SingleRun {
+    qint64 id = 0; // Attempt id, or one of the RUN_ID_ constants
     QString timeLabel;
     QVector<SingleSplit> splits;
 
-    QDomCharacterData realTimeTotal;
+    QDomCharacterData realTimeTotal; // Of the timing method shown
+    QDomCharacterData otherTotal;
+    QWidget *ruleWidget = NULL; // The line above the run, first of its widgets in the layout
+    QLabel *titleWidget = NULL;
     QLabel *realTimeTotalWidget = NULL;
     QTableWidget *tableWidget = NULL;
+    QWidget *placeholderWidget = NULL; // Takes the table's room while it isn't built
+    quint32 shownAt = 0; // The updateVisibleRuns pass that last found it on screen
     //QDomCharacterData xml;
     void ensureSpaceFor(int splitIdx);
 };
 
 enum ParseStateKind {
     PARSING_NONE,
+    PARSING_ROOT, // The document element itself
+    PARSING_TOPLEVEL, // Children of the document element
     PARSING_STANDALONE,
     PARSING_ATTEMPT_SCAN,
     PARSING_ATTEMPT,
@@ -80,30 +205,52 @@ enum ParseStateKind {
     PARSING_SEGMENT_SCAN,
     PARSING_SEGMENT,
     PARSING_SEGMENT_NAME,
-    PARSING_SEGMENT_PB_SPLITTIMES,
-    PARSING_SEGMENT_PB_SPLITTIME,
-    PARSING_SEGMENT_PB_REALTIME,
+    PARSING_SEGMENT_SPLITTIMES,
+    PARSING_SEGMENT_COMPARISON, // Any <SplitTime>, not only the Personal Best
+    PARSING_SEGMENT_COMPARISON_REALTIME,
     PARSING_SEGMENT_BESTSPLIT_BESTSEGMENTTIME,
     PARSING_SEGMENT_BESTSPLIT_REALTIME,
     PARSING_SEGMENT_HISTORY,
     PARSING_SEGMENT_HISTORY_RUN,
     PARSING_SEGMENT_HISTORY_RUN_REALTIME,
+    PARSING_KIND_COUNT
+};
+
+// Every tag name the parser reacts to, interned once so addNode can switch on integers
+enum ParseTag {
+    TAG_OTHER,
+    TAG_ATTEMPT_HISTORY,
+    TAG_SEGMENTS,
+    TAG_GAME_NAME,
+    TAG_CATEGORY_NAME,
+    TAG_ATTEMPT_COUNT,
+    TAG_OFFSET,
+    TAG_ATTEMPT,
+    TAG_REAL_TIME,
+    TAG_GAME_TIME,
+    TAG_SEGMENT,
+    TAG_NAME,
+    TAG_SPLIT_TIMES,
+    TAG_SPLIT_TIME,
+    TAG_BEST_SEGMENT_TIME,
+    TAG_SEGMENT_HISTORY,
+    TAG_TIME,
+    PARSE_TAG_COUNT
 };
+
+// The DOM walk keeps one of these per level in a fixed array, so it must stay plain data
 struct ParseState {
     ParseStateKind kind;
-    QDomNode node;
     bool dead;
 
     // Kind-specific data
-    QString str1; // standalone: name
-    qint64 int1; // attempt:id
-    ParseState clone(QDomNode with) {
-        ParseState result(*this);
-        result.node = with;
-        return result;
-    }
+    qint64 int1; // standalone: ParseTag, attempt: id, comparison: index
+    quint8 method; // TimingMethod, in the states for <RealTime> and <GameTime>
 };
 
+// Nothing the parser understands is nested deeper than this; deeper subtrees are skipped
+#define PARSE_STACK_DEPTH 32
+
 class XmlEdit : public DocumentEdit
 {
     Q_OBJECT
@@ -112,40 +259,159 @@ class XmlEdit : public DocumentEdit
 protected:
 	QDomDocument domDocument; // "Model"
 	QVBoxLayout *vLayout;
+	AttemptLayout *attemptLayout; // The attempts, last in vLayout, see applySort
 	bool correctingTable;
+	bool modified;
+	quint64 editGeneration; // Counts edits, so a save can tell if more happened while it ran
+	EditJournal journal; // Edits since the last save, for autosave
+	SaveBase saveBase; // The file as last read or saved, which snapshot() patches
+	QFuture<SaveBase> saveBaseIndexing; // Finds saveBase's parts on a worker, if indexingSaveBase
+	bool indexingSaveBase;
+	QHash<quint64, QDomElement> savePending; // Parts edited since saveBase, by SavePart key
+	QHash<quint64, QDomElement> saveInFlight; // Parts in the snapshot being saved, pending again if it fails
+	bool saveWhole; // Something no part covers was edited, so the next save serializes the document
+	bool saveInFlightWhole;
+	UndoHistory history;
+	bool renderEnabled; // If false, read() only fills in the data structures, and says why it failed in readError
+	QString readError;
+	bool readOnly; // Viewer mode: nothing can be edited, and read() lets go of the DOM after parsing
+	bool released; // domDocument has been let go, so only the parsed data is left
+	QHash<QString, QString> metadata; // The top-level text elements, kept when the DOM is released
+	QStringList recordBaseline; // recordsText() as last read from or saved to disk, so Live Reload can tell the user's edits from the timer's
+	bool deltaColumns; // Show the delta columns. Their cells are only filled in once on screen
+	bool visibleUpdatePending;
+	quint32 deltaEpoch; // Incremented to make every delta cell stale at once
+	int lazyTableLimit; // Attempt tables to keep built, or 0 to build them all up front
+	QVector<qint64> builtIds; // Attempts with a built table while tables are lazy
+	quint32 visiblePass; // Counts updateVisibleRuns passes, for SingleRun::shownAt
 
 	// GUI state
     qint64 topSegment; // Initialize to -1-- this is an index not a count
     SingleRun bestSplits, bestRun;
     QVector<qint64> runKeys;
+    QVector<qint64> runOrder; // Attempt ids in the order they're laid out, if sorted; empty means runKeys order
+    RunSortKey sortKey; // Kept across files, like timingMethod
+    int sortSegment;
+    bool sortDescending;
     QHash<qint64, SingleRun> runs;
+    QVector<SingleRun *> runsById; // runsById[id - 1], if the attempt ids are 1..N in order; otherwise empty
     QStringList splitNames;
+    TimingMethod timingMethod; // Kept across files
+
+    // Every <SplitTime name> in the file, each parsed into its own column of segments in the
+    // same pass. The shown one lives in bestRun instead, where everything that edits the
+    // Personal Best edits it; its entry here is an empty placeholder.
+    QStringList comparisonNames;
+    QVector<SingleRun> comparisons;
+    int shownComparison; // Index into comparisonNames, or -1 mid-parse
+    QString shownComparisonName; // Kept across rebuild()
 
     // GUI metrics
     bool columnWidthHave;
     int columnWidthName;
     int columnWidthTime;
+    int tableHeaderHeight; // For placeholders, measured once
+    int tableRowHeight; // Or 0 if not measured yet
 
     // Constants
     QStringList runTableLabels;
-    QHash<QString, QString> standaloneKeys;
+    QHash<int, QString> standaloneLabels; // Keyed by ParseTag
+    QHash<int, QLineEdit *> standaloneEdits; // Keyed by ParseTag
     QIcon nullIcon, stopIcon;
     QFont monoFont;
 
     qint64 fetchId(ParseState &state, QDomElement element);
     void addNodeFail(ParseState &state, QString message);
-	void addNode(ParseState &state, int depth, QWidget *content, QVBoxLayout *vContentLayout);
-    void renderRun(QString runLabel, SingleRun &run, QWidget *content, QVBoxLayout *vContentLayout);
+    void readFail(const QString &message);
+    bool parseDocument(const QVector<ScannedSegment> *segments = nullptr); // segments: scanned in parallel, cut from the DOM
+    void mergeScannedSegments(const QVector<ScannedSegment> &segments);
+    bool parseSubtree(QDomNode node, ParseState current);
+	void addNode(ParseState &state, const QDomNode &node, QWidget *content, QVBoxLayout *vContentLayout);
+    void renderRun(QString runLabel, SingleRun &run, QWidget *content, QLayout *vContentLayout);
+    QTableWidget *renderTable(SingleRun &run, QWidget *content);
+    int tableHeight(int rows);
+    void buildLazyTable(SingleRun &run);
+    void dropLazyTable(SingleRun &run);
+    void dropColdTables();
     void correctTable(SingleRun &run, bool truthIsTotal, bool changeFinalTotal);
+    SingleRun *runForId(qint64 id);
+    SingleRun &attemptRun(qint64 id) { return runsById.isEmpty() ? runs[id] : *runsById[id - 1]; } // id from runKeys
+    void indexRuns();
+    void writeSplit(SingleSplit &split); // For edits the journal can follow
+    void touchSaved(const QDomNode &node);
+    int comparisonIndex(const QString &name);
+    QVector<SingleRun *> comparisonColumns(QStringList *names = nullptr);
+    SingleRun &comparisonRun(int index) { return index == shownComparison ? bestRun : comparisons[index]; }
+    void padComparisons();
+    void refreshRun(SingleRun &run, bool truthIsTotal);
+    void setFinalTotal(SingleRun &run, bool present, uint64_t us);
+    void showSplits(SingleRun &run);
+    quint64 sortValue(const SingleRun &run, int ridx) const;
+    void applySort();
+    void invalidateDeltas(SingleRun &run, int first, int last);
+    void invalidateAllDeltas();
+    void scheduleVisibleUpdate();
+    void updateVisibleRuns();
+    void fillDeltas(SingleRun &run, int row);
+    void stepHistory(bool backward);
+    void pushHistory(const QVector<UndoEdit> &group);
+    void clearHistory(); // For changes the history can't describe
+    void finishStructuralEdit(); // Ends an edit that changes which row is which
+    void releaseDocument();
+    QVector<HistoryGarbage> sweepHistory(QVector<QDomElement> *elements) const;
+#ifndef QT_NO_CLIPBOARD
+    QTableWidget *focusedTable(SingleRun **run);
+#endif
 
 public:
     explicit XmlEdit(QWidget *parent = nullptr);
     virtual ~XmlEdit();
 
     bool isModified() const;
+    void setModified(bool m); // setModified(true) also counts as an edit
+    quint64 generation() const { return editGeneration; }
+
+    EditJournal &editJournal() { return journal; }
+    UndoHistory &editHistory() { return history; }
+    void setRenderEnabled(bool enabled) { renderEnabled = enabled; } // Off for command line tools
+    void setLazyTableLimit(int tables) { lazyTableLimit = tables; } // Takes effect at the next load
+    void setReadOnly(bool on) { readOnly = on; } // Takes effect at the next load
+    bool isReadOnly() const { return readOnly; }
+    bool isReleased() const { return released; } // If so, there is nothing to save
+
+    // Parsed data, for exporters
+    const QVector<qint64> &attemptIds() const { return runKeys; }
+    const QVector<qint64> &shownAttemptIds() const { return runOrder.isEmpty() ? runKeys : runOrder; } // In view order
+    const QHash<qint64, SingleRun> &attemptRuns() const { return runs; }
+    const QStringList &segmentNames() const { return splitNames; }
+    const QStringList &comparisonList() const { return comparisonNames; }
+    int comparison() const { return shownComparison; }
+    TimingMethod timing() const { return timingMethod; }
+    const SingleRun &personalBest() const { return bestRun; } // Or whichever comparison is shown
+    const SingleRun &bestSegments() const { return bestSplits; }
+    QString toplevelText(const QString &tag) const;
+    int replayJournal(const QVector<JournalEdit> &edits); // Returns number of edits applied
+    bool applyCellEdits(SingleRun &run, const QVector<CellEdit> &edits, QString *errorString);
 
     bool read(QIODevice *device);
+    bool readFile(const QString &fileName, QString *errorString); // Handles archives. errorString is set for IO errors, and for parse errors when rendering is off
+    int ingestFile(const QString &fileName, bool *structureChanged, bool *recordsKept, QString *errorString); // Returns attempts added, or -1
+    QStringList recordsText() const; // Each segment's <SplitTimes> and <BestSegmentTime> text, in order
+    void setRecordBaseline(const QStringList &records) { recordBaseline = records; } // After saving them
+    void rebuild(); // Reparse the views from the DOM, keeping edits and scroll position
+    int appendAttempts(const QVector<ImportedAttempt> &attempts, QString *errorString); // Returns count added, or -1
+    qint64 transformTimes(const TimeTransform &transform, QString *errorString); // Returns splits changed, or -1
+    bool remapSegments(const SegmentLayout &layout, QString *errorString);
+    bool mergeSegments(int first, const QString &name, QString *errorString); // With the segment after first
+    bool splitSegment(int index, const QString &firstName, quint64 firstPpm, const QHash<qint64, uint64_t> &firstUs, QString *errorString);
+    QVector<RunRepair> findRepairs() const; // Changes nothing, so the caller can show them first
+    bool applyRepairs(const QVector<RunRepair> &repairs, QString *errorString);
+    QVector<HistoryGarbage> findGarbage() const { return sweepHistory(NULL); } // Changes nothing, for a dry run
+    qint64 collectGarbage(QString *errorString); // Removes what findGarbage finds. Returns bytes saved, or -1
+    bool compactIds(QString *errorString); // Renumber attempts 1..N by start time
     bool write(QIODevice *device) const;
+    SaveSnapshot snapshot(); // What a save of the document now should write, without sharing its nodes
+    void finishSnapshot(bool saved, const SaveBase &base); // base from SnapshotSaver::savedBase
 
 public Q_SLOTS:
 #ifndef QT_NO_CLIPBOARD
@@ -153,10 +419,18 @@ public Q_SLOTS:
     void copy();
     void paste();
 #endif
-    //void undo();
-    //void redo();
+    void undo();
+    void redo();
     void clear(); // Also resets file state
     void clearUi(); // Also resets file state
+    void setTimingMethod(TimingMethod method);
+    void setComparison(int index);
+    void setDeltaColumns(bool shown);
+    void sortAttempts(RunSortKey key, int segment, bool descending); // segment is for SORT_SEGMENT_TIME
+    void showAttempt(qint64 id); // Scroll its table to the top
+Q_SIGNALS:
+    void comparisonsChanged(); // After every parse, since the names come from the file
+    void dataChanged(); // Any change to the times, names or what's shown, once it's complete
 };
 
 class XmlEditTableWatcher : public QObject {